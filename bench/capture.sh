@@ -0,0 +1,16 @@
+#!/usr/bin/env bash
+# Command substitution: one large capture and many small ones
+. "$(dirname "$0")/common.sh"
+
+SIZE_MIB=${SIZE_MIB:-100}
+COUNT=${COUNT:-1000}
+
+head -c $((SIZE_MIB * 1024 * 1024)) /dev/zero | tr '\0' 'x' > "$TMP/data"
+echo 'X="$(cat "$DATA")"' > "$TMP/large"
+bench "capture $SIZE_MIB MiB" 'DATA="$TMP/data" "$MESH" < "$TMP/large"'
+
+# External command (forked subshell) and built-in (in-process)
+yes 'X="$(/bin/echo x)"' | head -n "$COUNT" > "$TMP/external"
+yes 'X="$(hash)"' | head -n "$COUNT" > "$TMP/builtin"
+bench "$COUNT small captures, external" '"$MESH" < "$TMP/external"'
+bench "$COUNT small captures, built-in" '"$MESH" < "$TMP/builtin"'
@@ -0,0 +1,26 @@
+# Shared helpers for the benchmark scripts (sourced, not run)
+#
+# MESH - shell binary to measure (default: release build)
+
+MESH=${MESH:-$(dirname "$0")/../build/bin/mesh}
+if [ ! -x "$MESH" ]; then
+	echo "mesh not found at '$MESH'; run 'make release' or set MESH" >&2
+	exit 1
+fi
+
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+# bench NAME CODE - time shell code (output is discarded)
+# Sets ELAPSED_US for follow-up calculations
+bench() {
+	local start end
+	start=$(date +%s%N)
+	if ! eval "$2" > /dev/null; then
+		echo "$1: failed" >&2
+	fi
+	end=$(date +%s%N)
+
+	ELAPSED_US=$(((end - start) / 1000))
+	printf '%-48s %8d ms\n' "$1" $((ELAPSED_US / 1000))
+}
@@ -0,0 +1,24 @@
+#!/usr/bin/env bash
+# Non-interactive command input: a long command stream and one long command
+# read through a pipe, a file, a script and '-c'
+. "$(dirname "$0")/common.sh"
+
+COUNT=${COUNT:-1000000}
+# '-c' takes a single argument, which is limited by ARG_MAX
+ARG_COUNT=${ARG_COUNT:-100000}
+
+yes 'A=1' | head -n "$COUNT" > "$TMP/stream"
+bench "pipe, $COUNT commands" 'cat "$TMP/stream" | "$MESH"'
+bench "stdin file, $COUNT commands" '"$MESH" < "$TMP/stream"'
+bench "script, $COUNT commands" '"$MESH" "$TMP/stream"'
+bench "-c, $ARG_COUNT commands" \
+	'"$MESH" -c "$(head -n "$ARG_COUNT" "$TMP/stream")"'
+
+# Quoted value spanning many lines is a single command
+{
+	printf "A='"
+	yes 'x' | head -n "$COUNT"
+	printf "'\n"
+} > "$TMP/long"
+bench "pipe, 1 command of $COUNT lines" 'cat "$TMP/long" | "$MESH"'
+bench "stdin file, 1 command of $COUNT lines" '"$MESH" < "$TMP/long"'
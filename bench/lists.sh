@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+# Stress test: single command lines with very long ';', '&&' and '||' lists
+. "$(dirname "$0")/common.sh"
+
+CLAUSES=${CLAUSES:-1000000}
+
+# clause_line SEPARATOR - one line with CLAUSES assignments
+clause_line() {
+	yes 'A=1' | head -n "$CLAUSES" | paste -sd "$1"
+}
+
+clause_line ';' > "$TMP/seq"
+clause_line '&' | sed 's/&/ \&\& /g' > "$TMP/and"
+clause_line '|' | sed 's/|/ || /g' > "$TMP/or"
+
+bench "$CLAUSES clauses with ';'" '"$MESH" < "$TMP/seq"'
+bench "$CLAUSES clauses with '&&'" '"$MESH" < "$TMP/and"'
+bench "$CLAUSES clauses with '||'" '"$MESH" < "$TMP/or"'
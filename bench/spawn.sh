@@ -0,0 +1,32 @@
+#!/usr/bin/env bash
+# External command latency against the size of the shell's heap
+. "$(dirname "$0")/common.sh"
+
+SPAWNS=${SPAWNS:-1000}
+# Heap sizes to test, in MiB
+HEAP_MIB=${HEAP_MIB:-"0 64 256 1024"}
+
+for mib in $HEAP_MIB; do
+	# 64 MiB string by doubling, then copies of it in unexported variables
+	{
+		if [ "$mib" -gt 0 ]; then
+			echo 'A=x'
+			for _ in $(seq 26); do
+				echo 'A=$A$A'
+			done
+			for i in $(seq $((mib / 64))); do
+				echo "V$i=\$A"
+			done
+		fi
+	} > "$TMP/heap"
+	{
+		cat "$TMP/heap"
+		yes /bin/true | head -n "$SPAWNS"
+	} > "$TMP/spawn"
+
+	bench "heap $mib MiB, setup only" '"$MESH" < "$TMP/heap"'
+	setup_us=$ELAPSED_US
+	bench "heap $mib MiB, $SPAWNS spawns" '"$MESH" < "$TMP/spawn"'
+	printf '%-48s %8d us\n' "heap $mib MiB, per spawn" \
+		$(((ELAPSED_US - setup_us) / SPAWNS))
+done
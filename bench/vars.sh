@@ -0,0 +1,18 @@
+#!/usr/bin/env bash
+# Variable lookups and updates against the size of the environment
+. "$(dirname "$0")/common.sh"
+
+COUNT=${COUNT:-200000}
+SIZES=${SIZES:-"50 500 5000"}
+
+for size in $SIZES; do
+	env_args=()
+	for i in $(seq "$size"); do
+		env_args+=("VAR$i=value$i")
+	done
+
+	# Read a variable near the end of the environment and update another
+	yes "X=\$VAR$size" | head -n "$COUNT" > "$TMP/script"
+	bench "$size variables, $COUNT expansions" \
+		'env -i "${env_args[@]}" "$MESH" < "$TMP/script"'
+done
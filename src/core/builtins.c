@@ -20,6 +20,10 @@
 
 #include "../util/error.h"
 #include "../util/helper.h"
+#include "exec.h"
+#include "jobs.h"
+#include "path.h"
+#include "scope.h"
 #include "vars.h"
 
 // Builtin table entry
@@ -27,36 +31,60 @@
 struct builtin {
 	const char *name;
 	cmd_res (*const func)(uint32_t argc, char **argv);
+	// Does not change shell state when run without arguments (can run
+	// in-process for substitutions)
+	int pure;
 };
 
 // Builtin functions
 static cmd_res shell_exit(uint32_t argc, char **argv);
 static cmd_res shell_cd(uint32_t argc, char **argv);
 static cmd_res shell_set(uint32_t argc, char **argv);
+static cmd_res shell_shift(uint32_t argc, char **argv);
 static cmd_res shell_export(uint32_t argc, char **argv);
 static cmd_res shell_exec(uint32_t argc, char **argv);
+static cmd_res shell_jobs(uint32_t argc, char **argv);
+static cmd_res shell_wait(uint32_t argc, char **argv);
+static cmd_res shell_fg(uint32_t argc, char **argv);
+static cmd_res shell_bg(uint32_t argc, char **argv);
+static cmd_res shell_hash(uint32_t argc, char **argv);
 
 // Builtin registry
 static const builtin registry[] = {
-	{ .name = "exit", .func = &shell_exit },
-	{ .name = "cd", .func = &shell_cd },
-	{ .name = "set", .func = &shell_set },
-	{ .name = "export", .func = &shell_export },
-	{ .name = "exec", .func = &shell_exec },
+	{ .name = "exit", .func = &shell_exit, .pure = 0 },
+	{ .name = "cd", .func = &shell_cd, .pure = 0 },
+	{ .name = "set", .func = &shell_set, .pure = 1 },
+	{ .name = "shift", .func = &shell_shift, .pure = 0 },
+	{ .name = "export", .func = &shell_export, .pure = 1 },
+	{ .name = "exec", .func = &shell_exec, .pure = 0 },
+	{ .name = "jobs", .func = &shell_jobs, .pure = 0 },
+	{ .name = "wait", .func = &shell_wait, .pure = 0 },
+	{ .name = "fg", .func = &shell_fg, .pure = 0 },
+	{ .name = "bg", .func = &shell_bg, .pure = 0 },
+	{ .name = "hash", .func = &shell_hash, .pure = 1 },
 };
 static const size_t registry_length = sizeof(registry) / sizeof(builtin);
 
 int pure_assign(uint32_t count, char **args, int export_flag) {
 	for (uint32_t i = 0; i < count; i++) {
-		char *key = strtok(args[i], "=");
-		char *value = strtok(NULL, "=");
-
-		vars_set(key, value);
+		// Arguments may point into the parsed tree; don't modify them
+		char *equals = strchr(args[i], '=');
+		char *key = (equals != NULL) ? strndup(args[i], equals - args[i])
+									 : strdup(args[i]);
+		char *value = (equals != NULL) ? equals + 1 : NULL;
+
+		// 'export NAME' keeps the current value; 'export NAME=' clears it
+		if (value != NULL || vars_get(key) == NULL) {
+			vars_set(key, value);
+		}
 		if (export_flag) {
 			if (vars_set_export(key) < 0) {
+				free(key);
 				return -1;
 			}
 		}
+
+		free(key);
 	}
 
 	return 0;
@@ -72,6 +100,10 @@ const builtin *search_builtins(const char *name) {
 	return NULL;
 }
 
+int builtin_is_pure(const builtin *cmd) {
+	return cmd->pure;
+}
+
 int run_builtin(const builtin *cmd, string_vector *args) {
 	return cmd->func(args->count, args->data);
 }
@@ -132,6 +164,16 @@ static cmd_res shell_cd(uint32_t argc, char **argv) {
 }
 
 static cmd_res shell_set(uint32_t argc, char **argv) {
+	// Replace positional arguments
+	if (argc > 1 && strcmp(argv[1], "--") == 0) {
+		scope_reset_pos();
+		for (uint32_t i = 2; i < argc; i++) {
+			scope_append_pos(argv[i]);
+		}
+
+		return CMDRES_OK;
+	}
+
 	if (argc > 1) {
 		// TODO: implement
 		print_error("set: this function is not implemented");
@@ -142,6 +184,37 @@ static cmd_res shell_set(uint32_t argc, char **argv) {
 	return CMDRES_OK;
 }
 
+static cmd_res shell_shift(uint32_t argc, char **argv) {
+	if (argc > 2) {
+		print_error("shift: too many arguments\n");
+		return CMDRES_USAGE;
+	}
+
+	unsigned long count = 1;
+	if (argc == 2) {
+		// strtoul also takes blanks, signs and an empty string
+		char *end;
+		errno = 0;
+		count = strtoul(argv[1], &end, 10);
+
+		if (argv[1][0] < '0' || argv[1][0] > '9' || *end != '\0') {
+			print_error("shift: invalid count '%s'\n", argv[1]);
+			return CMDRES_USAGE;
+		}
+		if (errno == ERANGE || count > UINT32_MAX) {
+			print_error("shift: count out of range\n");
+			return CMDRES_GENERAL;
+		}
+	}
+
+	if (scope_shift_pos(count) < 0) {
+		print_error("shift: count out of range\n");
+		return CMDRES_GENERAL;
+	}
+
+	return CMDRES_OK;
+}
+
 static cmd_res shell_export(uint32_t argc, char **argv) {
 	if (argc == 1) {
 		vars_print_all(1);
@@ -157,16 +230,116 @@ static cmd_res shell_exec(uint32_t argc, char **argv) {
 		return CMDRES_OK;
 	}
 
+	// First argument is skipped; argv is not null-terminated
+	char *exec_argv[argc];
+	memcpy(exec_argv, argv + 1, (argc - 1) * sizeof(char *));
+	exec_argv[argc - 1] = NULL;
+
+	// Shell keeps its signal handling if there is nothing to run
+	const char *file = path_resolve(exec_argv[0]);
+	if (file == NULL) {
+		print_error("exec: %s: command not found\n", exec_argv[0]);
+		return CMDRES_GENERAL;
+	}
+
 	extern char **environ;
-	environ = vars_export();
+	environ = (char **)vars_export();
+
+	exec_reset_signals();
+	exec_file(file, exec_argv);
+
+	print_error("exec: %s: %s\n", exec_argv[0], strerror(errno));
+	exit(CMDRES_GENERAL);
+}
+
+static cmd_res shell_jobs(uint32_t argc, unused char **argv) {
+	if (argc > 1) {
+		print_error("jobs: too many arguments\n");
+		return CMDRES_USAGE;
+	}
+
+	jobs_print(0);
+	return CMDRES_OK;
+}
+
+static cmd_res shell_wait(uint32_t argc, char **argv) {
+	// Interrupted by Ctrl-C, same status as sh
+	if (argc == 1) {
+		return (jobs_wait_all() < 0) ? 128 + SIGINT : CMDRES_OK;
+	}
 
-	signal(SIGINT, SIG_DFL);
-	signal(SIGQUIT, SIG_DFL);
+	int result = CMDRES_OK;
+	for (uint32_t i = 1; i < argc; i++) {
+		job *target = jobs_find(argv[i]);
+		if (target == NULL) {
+			print_error("wait: %s: no such job\n", argv[i]);
+			result = 127;
+			continue;
+		}
 
-	// First argument is skipped
-	char **exec_argv = argv + 1;
-	execvp(exec_argv[0], exec_argv);
+		result = jobs_wait(target);
+		if (result < 0) {
+			return 128 + SIGINT;
+		}
+	}
+
+	return result;
+}
+
+static cmd_res shell_fg(uint32_t argc, char **argv) {
+	if (argc > 2) {
+		print_error("fg: too many arguments\n");
+		return CMDRES_USAGE;
+	}
+
+	job *target = jobs_find((argc == 2) ? argv[1] : NULL);
+	if (target == NULL) {
+		print_error("fg: no such job\n");
+		return CMDRES_GENERAL;
+	}
+
+	return jobs_foreground(target);
+}
+
+static cmd_res shell_bg(uint32_t argc, char **argv) {
+	if (argc > 2) {
+		print_error("bg: too many arguments\n");
+		return CMDRES_USAGE;
+	}
+
+	job *target = jobs_find((argc == 2) ? argv[1] : NULL);
+	if (target == NULL) {
+		print_error("bg: no such job\n");
+		return CMDRES_GENERAL;
+	}
+
+	if (jobs_background(target) < 0) {
+		return CMDRES_GENERAL;
+	}
+
+	return CMDRES_OK;
+}
+
+static cmd_res shell_hash(uint32_t argc, char **argv) {
+	if (argc == 1) {
+		path_print();
+		return CMDRES_OK;
+	}
+
+	if (strcmp(argv[1], "-r") == 0) {
+		path_invalidate();
+		return CMDRES_OK;
+	}
+
+	int result = CMDRES_OK;
+	// Named commands are always searched again
+	for (uint32_t i = 1; i < argc; i++) {
+		path_forget(argv[i]);
+		if (path_resolve(argv[i]) == NULL) {
+			print_error("hash: %s: not found\n", argv[i]);
+			result = CMDRES_GENERAL;
+		}
+	}
 
-	print_error("exec: %s: command not found\n", exec_argv[0]);
-	return CMDRES_GENERAL;
+	return result;
 }
@@ -34,6 +34,16 @@ int pure_assign(uint32_t count, char **args, int export_flag);
  */
 const builtin *search_builtins(const char *name);
 
+/**
+ * @brief Check if a built-in leaves shell state unchanged.
+ *
+ * @param[in] cmd - Built-in identifier.
+ * @return Boolean result.
+ * @note Only holds when it is run without arguments (e.g. 'set' lists
+ * variables).
+ */
+int builtin_is_pure(const builtin *cmd);
+
 /**
  * @brief Run shell builtin.
  *
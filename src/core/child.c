@@ -0,0 +1,289 @@
+/**
+ * @file core/child.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Child process tracking.
+ */
+#define _POSIX_C_SOURCE 200809L
+// wait4 and syscall are not part of POSIX
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include "child.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <c-utils/vector.h>
+
+#include "events.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#if defined(SYS_pidfd_open) && defined(SYS_waitid)
+#define HAVE_PIDFD
+#ifndef P_PIDFD
+#define P_PIDFD 3
+#endif
+#endif
+#endif
+
+typedef vector child_vector;
+
+static child_vector children = { 0 };
+// Cleared if waitid(P_PIDFD) is missing (Linux < 5.4 or seccomp filters)
+static int pidfd_waitid = 1;
+
+static int open_pidfd(pid_t pid);
+static int poll_pidfd(child_proc *proc, int options);
+static int poll_pid(child_proc *proc, int options);
+
+void child_track(pid_t pid) {
+	if (children.data == NULL) {
+		children = vec_init(sizeof(child_proc));
+	}
+
+	// Stale entry inherited from a parent shell with a recycled PID
+	child_forget(pid);
+
+	child_proc proc = {
+		.pid = pid,
+		.pidfd = open_pidfd(pid),
+		.state = CHILD_RUNNING,
+		.status = 0,
+		.signal = 0,
+	};
+	memset(&proc.usage, 0, sizeof(struct rusage));
+
+	vec_push(&children, &proc);
+	events_watch_child(proc.pidfd);
+}
+
+child_proc *child_get(pid_t pid) {
+	for (uint32_t i = 0; i < children.count; i++) {
+		child_proc *proc = vec_at_mut(&children, i);
+		if (proc->pid == pid) {
+			return proc;
+		}
+	}
+
+	return NULL;
+}
+
+int child_poll(child_proc *proc, int options) {
+	if (proc->state == CHILD_EXITED) {
+		return 0;
+	}
+
+	// Let the event loop do the blocking
+	int blocking = !(options & CHILD_NOHANG) && events_active();
+	if (blocking) {
+		options |= CHILD_NOHANG;
+	}
+
+	while (1) {
+		int res = (proc->pidfd >= 0 && pidfd_waitid)
+			? poll_pidfd(proc, options)
+			: poll_pid(proc, options);
+
+		if (res < 0 && errno == EINTR) {
+			continue;
+		}
+		if (res != 0 || !blocking) {
+			return res;
+		}
+
+		int ready = events_wait(-1, -1);
+		if (ready < 0) {
+			return -1;
+		}
+
+		// Let the caller decide whether Ctrl-C ends the wait
+		if (ready & EVENT_INTERRUPT) {
+			errno = EINTR;
+			return -1;
+		}
+	}
+}
+
+int child_collect(pid_t pid) {
+	child_proc *proc = child_get(pid);
+	if (proc == NULL) {
+		child_track(pid);
+		proc = child_get(pid);
+	}
+
+	while (proc->state != CHILD_EXITED) {
+		if (child_poll(proc, 0) < 0) {
+			// Foreground child got the same SIGINT; wait for it to exit
+			if (errno == EINTR) {
+				continue;
+			}
+
+			child_forget(pid);
+			return -1;
+		}
+	}
+
+	int code = child_result(proc);
+	child_forget(pid);
+
+	return code;
+}
+
+int child_result(const child_proc *proc) {
+	if (proc->state == CHILD_EXITED && proc->signal != 0) {
+		return 128 + proc->signal;
+	}
+	if (proc->state == CHILD_STOPPED) {
+		return 128 + proc->signal;
+	}
+
+	return proc->status;
+}
+
+void child_forget(pid_t pid) {
+	for (uint32_t i = 0; i < children.count; i++) {
+		child_proc *proc = vec_at_mut(&children, i);
+		if (proc->pid != pid) {
+			continue;
+		}
+
+		if (proc->pidfd >= 0) {
+			events_unwatch_child(proc->pidfd);
+			close(proc->pidfd);
+		}
+		vec_erase(&children, i, NULL);
+		return;
+	}
+}
+
+/** Internal */
+
+/**
+ * @brief Open a process file descriptor.
+ *
+ * @param[in] pid - Child PID.
+ * @return File descriptor; -1 if not supported.
+ */
+static int open_pidfd(pid_t pid) {
+#ifdef HAVE_PIDFD
+	// Close-on-exec is set by the kernel
+	return syscall(SYS_pidfd_open, pid, 0);
+#else
+	(void)pid;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Wait on a child through its process file descriptor.
+ *
+ * @param[in,out] proc - Child object.
+ * @param[in] options - CHILD_NOHANG and/or CHILD_UNTRACED.
+ * @return 1 if state changed; 0 if not; -1 on error.
+ */
+static int poll_pidfd(child_proc *proc, int options) {
+#ifdef HAVE_PIDFD
+	int wait_opts = WEXITED | WCONTINUED;
+	if (options & CHILD_NOHANG) {
+		wait_opts |= WNOHANG;
+	}
+	if (options & CHILD_UNTRACED) {
+		wait_opts |= WSTOPPED;
+	}
+
+	// Raw syscall also reports resource usage
+	siginfo_t info;
+	memset(&info, 0, sizeof(siginfo_t));
+	if (syscall(SYS_waitid, P_PIDFD, proc->pidfd, &info, wait_opts,
+			&proc->usage) < 0) {
+		// pidfd still works for events, so only the wait falls back
+		if (errno == EINVAL || errno == ENOSYS) {
+			pidfd_waitid = 0;
+			return poll_pid(proc, options);
+		}
+		return -1;
+	}
+
+	if (info.si_pid == 0) {
+		return 0;
+	}
+
+	switch (info.si_code) {
+	case CLD_EXITED:
+		proc->state = CHILD_EXITED;
+		proc->status = info.si_status;
+		proc->signal = 0;
+		break;
+	case CLD_KILLED:
+	case CLD_DUMPED:
+		proc->state = CHILD_EXITED;
+		proc->signal = info.si_status;
+		break;
+	case CLD_STOPPED:
+	case CLD_TRAPPED:
+		proc->state = CHILD_STOPPED;
+		proc->signal = info.si_status;
+		break;
+	case CLD_CONTINUED:
+		proc->state = CHILD_RUNNING;
+		proc->signal = 0;
+		break;
+	}
+
+	return 1;
+#else
+	(void)proc;
+	(void)options;
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/**
+ * @brief Wait on a child by PID.
+ *
+ * @param[in,out] proc - Child object.
+ * @param[in] options - CHILD_NOHANG and/or CHILD_UNTRACED.
+ * @return 1 if state changed; 0 if not; -1 on error.
+ */
+static int poll_pid(child_proc *proc, int options) {
+	int wait_opts = WCONTINUED;
+	if (options & CHILD_NOHANG) {
+		wait_opts |= WNOHANG;
+	}
+	if (options & CHILD_UNTRACED) {
+		wait_opts |= WUNTRACED;
+	}
+
+	int status;
+	pid_t res = wait4(proc->pid, &status, wait_opts, &proc->usage);
+	if (res <= 0) {
+		return res;
+	}
+
+	if (WIFEXITED(status)) {
+		proc->state = CHILD_EXITED;
+		proc->status = WEXITSTATUS(status);
+		proc->signal = 0;
+	} else if (WIFSIGNALED(status)) {
+		proc->state = CHILD_EXITED;
+		proc->signal = WTERMSIG(status);
+	} else if (WIFSTOPPED(status)) {
+		proc->state = CHILD_STOPPED;
+		proc->signal = WSTOPSIG(status);
+	} else if (WIFCONTINUED(status)) {
+		proc->state = CHILD_RUNNING;
+		proc->signal = 0;
+	}
+
+	return 1;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file core/child.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Child process tracking.
+ */
+#pragma once
+
+#include <sys/resource.h>
+#include <sys/types.h>
+
+typedef enum {
+	CHILD_RUNNING,
+	CHILD_STOPPED,
+	CHILD_EXITED,
+} child_state;
+
+// Options for child_poll
+#define CHILD_NOHANG 0x1
+#define CHILD_UNTRACED 0x2
+
+typedef struct {
+	pid_t pid;
+	// Process file descriptor; -1 if not supported
+	int pidfd;
+
+	child_state state;
+	// Exit status if exited normally
+	int status;
+	// Terminating or stopping signal; 0 if none
+	int signal;
+	struct rusage usage;
+} child_proc;
+
+/**
+ * @brief Start tracking a new child process.
+ *
+ * @param[in] pid - Child PID.
+ */
+void child_track(pid_t pid);
+
+/**
+ * @brief Get tracked child by PID.
+ *
+ * @param[in] pid - Child PID.
+ * @return Child object; NULL if not tracked.
+ */
+child_proc *child_get(pid_t pid);
+
+/**
+ * @brief Wait for a state change of a specific child.
+ *
+ * @param[in,out] proc - Child object.
+ * @param[in] options - CHILD_NOHANG and/or CHILD_UNTRACED.
+ * @return 1 if state changed; 0 if not (CHILD_NOHANG); -1 on error.
+ * @note Blocking waits fail with EINTR when SIGINT arrives.
+ */
+int child_poll(child_proc *proc, int options);
+
+/**
+ * @brief Wait for a child to exit and stop tracking it.
+ *
+ * @param[in] pid - Child PID.
+ * @return Return code; 128 + signal number if killed; -1 on error.
+ */
+int child_collect(pid_t pid);
+
+/**
+ * @brief Get shell return code of an exited child.
+ *
+ * @param[in] proc - Child object.
+ * @return Return code; 128 + signal number if killed.
+ */
+int child_result(const child_proc *proc);
+
+/**
+ * @brief Stop tracking a child.
+ *
+ * @param[in] pid - Child PID.
+ */
+void child_forget(pid_t pid);
@@ -13,52 +13,77 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <unistd.h>
 
-#include <c-utils/stack.h>
 #include <c-utils/vector.h>
 
 #include "../grammar/ast.h"
 #include "../grammar/expand.h"
 #include "../util/error.h"
+#include "builtins.h"
+#include "child.h"
+#include "exec.h"
 #include "flags.h"
+#include "jobs.h"
 #include "run.h"
 #include "vars.h"
 
-// Track quote state
-typedef enum {
-	Q_NONE,
-	Q_SINGLE,
-	Q_DOUBLE
-} quote_st;
-
-static int eval_seq(ast_node *seq, int carry_async);
+static int eval_seq(ast_node *seq);
+static int eval_list_item(ast_node *item, int async);
 
 static int eval_child(ast_node *child, run_flags *flags);
 static int eval_cond(ast_node *cond, run_flags *flags);
 static int eval_pipe(ast_node *pipeline, run_flags *flags);
+static int eval_last_stage(ast_node *stage, int fd_in, run_flags *flags);
 static int eval_run(ast_node *run, run_flags *flags);
 
-static string_vector *to_argv(ast_node *target);
-static void add_word_to_argv(ast_node *word, string_vector *argv);
-static void to_flags(ast_node *apply, run_flags *flags);
-static void add_redir_to_flags(ast_node *rdr, run_flags *flags);
-static void add_assign_to_flags(ast_node *node, run_flags *flags);
+static string_vector *to_argv(const ast_command *cmd, string_vector *owned);
+static void to_flags(const ast_command *cmd, run_flags *flags);
+static void add_redir_to_flags(const ast_node *rdr, run_flags *flags);
+static void add_assign_to_flags(const ast_node *node, run_flags *flags);
 
 int eval_ast(ast_node *root) {
+	int result;
 	if (root->kind == AST_KIND_SEQ) {
-		return eval_seq(root, 0);
+		result = eval_seq(root);
+	} else {
+		run_flags empty_set = {
+			.redirs = vec_init(sizeof(redir)),
+			.assigns = vec_init(sizeof(assign)),
+		};
+
+		result = eval_child(root, &empty_set);
+		del_flags(&empty_set);
 	}
 
-	run_flags empty_set = {
-		.redirs = vec_init(sizeof(redir)),
-		.assigns = vec_init(sizeof(assign)),
-	};
+	// Background jobs that finished meanwhile would stay zombies otherwise
+	jobs_reap();
+	return result;
+}
 
-	int result = eval_child(root, &empty_set);
-	del_flags(&empty_set);
+int eval_ast_flags(ast_node *root, run_flags *flags) {
+	if (root->kind == AST_KIND_SEQ) {
+		return eval_seq(root);
+	}
 
-	return result;
+	return eval_child(root, flags);
+}
+
+int eval_is_pure(const ast_node *root) {
+	if (root->kind != AST_KIND_RUN) {
+		return 0;
+	}
+
+	// Prefixes and redirections have to stay out of the shell, and
+	// built-ins only list state when run without arguments
+	const ast_command *cmd = root->value.cmd;
+	if (cmd->word_count != 1 || cmd->assign_count > 0 || cmd->redir_count > 0) {
+		return 0;
+	}
+
+	const builtin *command = search_builtins(cmd->words[0]->value.str);
+	return command != NULL && builtin_is_pure(command);
 }
 
 /**
@@ -85,32 +110,84 @@ static int eval_child(ast_node *child, run_flags *flags) {
  * @brief Evaluate sequence node.
  *
  * @param[in] seq - Sequence node.
- * @param[in] carry_async - Whether the right child should be run async.
  * @return Evaluation result.
  */
-static int eval_seq(ast_node *seq, int carry_async) {
+static int eval_seq(ast_node *seq) {
+	// Lists can be very long, so walk the left-leaning chain without recursion
+	vector chain = vec_init(sizeof(ast_node *));
+	while (seq->kind == AST_KIND_SEQ) {
+		vec_push(&chain, &seq);
+		seq = seq->left;
+	}
+
+	// Separator after an item decides if it runs async
+	int result = 0;
+	ast_node *item = seq;
+	for (uint32_t i = chain.count; i > 0; i--) {
+		ast_node *const *node = vec_at(&chain, i - 1);
+		if (item != NULL) {
+			int async = ((*node)->value.seq == AST_SEQ_ASYNC);
+			result = eval_list_item(item, async);
+		}
+
+		item = (*node)->right;
+	}
+
+	// Last item has no separator
+	if (item != NULL) {
+		result = eval_list_item(item, 0);
+	}
+
+	vec_deinit(&chain);
+	return result;
+}
+
+/**
+ * @brief Evaluate one item of a list.
+ *
+ * @param[in] item - List item node.
+ * @param[in] async - Whether to run the item as a background job.
+ * @return Evaluation result.
+ */
+static int eval_list_item(ast_node *item, int async) {
 	run_flags flags = {
 		.redirs = vec_init(sizeof(redir)),
 		.assigns = vec_init(sizeof(assign)),
 	};
 
-	int result;
+	if (!async) {
+		int result = eval_child(item, &flags);
+		del_flags(&flags);
 
-	// Left side - required
-	if (seq->left->kind == AST_KIND_SEQ) {
-		// TODO: implement async eval
-		result = eval_seq(seq->left, seq->value.seq == AST_SEQ_ASYNC);
-	} else {
-		result = eval_child(seq->left, &flags);
+		jobs_reap();
+		return result;
 	}
 
-	// Right side - optional
-	if (seq->right != NULL) {
-		result = eval_child(seq->right, &flags);
+	// Child will inherit unflushed buffers
+	fflush(stdout);
+	fflush(stderr);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		print_error("failed to create new process\n");
+		del_flags(&flags);
+		return -1;
+	}
+
+	if (pid == 0) {
+		jobs_setup_child();
+		exec_reset_signals();
+
+		// Simple commands can replace the job process
+		flags.in_child = (item->kind == AST_KIND_RUN);
+		exit(eval_child(item, &flags));
 	}
 
+	child_track(pid);
+	jobs_add(pid);
+
 	del_flags(&flags);
-	return result;
+	return 0;
 }
 
 /**
@@ -121,16 +198,26 @@ static int eval_seq(ast_node *seq, int carry_async) {
  * @return Evaluation result.
  */
 static int eval_cond(ast_node *cond, run_flags *flags) {
-	int left_result = eval_child(cond->left, flags);
-
-	if (cond->value.cond == AST_COND_AND && left_result == 0) {
-		return eval_child(cond->right, flags);
+	// Parser will always build the tree to the left
+	vector chain = vec_init(sizeof(ast_node *));
+	while (cond->kind == AST_KIND_COND) {
+		vec_push(&chain, &cond);
+		cond = cond->left;
 	}
-	if (cond->value.cond == AST_COND_OR && left_result != 0) {
-		return eval_child(cond->right, flags);
+
+	int result = eval_child(cond, flags);
+	for (uint32_t i = chain.count; i > 0; i--) {
+		ast_node *const *node = vec_at(&chain, i - 1);
+		ast_cond_value type = (*node)->value.cond;
+
+		if ((type == AST_COND_AND && result == 0)
+			|| (type == AST_COND_OR && result != 0)) {
+			result = eval_child((*node)->right, flags);
+		}
 	}
 
-	return left_result;
+	vec_deinit(&chain);
+	return result;
 }
 
 /**
@@ -141,37 +228,117 @@ static int eval_cond(ast_node *cond, run_flags *flags) {
  * @return Evaluation result.
  */
 static int eval_pipe(ast_node *pipeline, run_flags *flags) {
-	int pipe_fds[2];
-	if (pipe(pipe_fds) < 0) {
+	// Parser will always build the tree to the left
+	uint32_t count = 1;
+	ast_node *trav = pipeline;
+	while (trav->kind == AST_KIND_PIPE) {
+		trav = trav->left;
+		count++;
+	}
+
+	ast_node *stages[count];
+	trav = pipeline;
+	for (uint32_t i = count - 1; i > 0; i--) {
+		stages[i] = trav->right;
+		trav = trav->left;
+	}
+	stages[0] = trav;
+
+	// Child will inherit unflushed buffers
+	fflush(stdout);
+	fflush(stderr);
+
+	// Start all but the last stage before waiting on any of them
+	pid_t pids[count];
+	int prev_read = -1;
+	uint32_t started = 0;
+	for (uint32_t i = 0; i < count - 1; i++) {
+		int pipe_fds[2];
+		if (pipe(pipe_fds) < 0) {
+			print_error("failed to create pipe\n");
+			break;
+		}
+
+		pid_t pid = fork();
+		if (pid < 0) {
+			print_error("failed to create new process\n");
+			close(pipe_fds[0]);
+			close(pipe_fds[1]);
+			break;
+		}
+
+		if (pid == 0) {
+			// Child - wire pipe ends and close the unused ones
+			if (prev_read >= 0) {
+				dup2(prev_read, STDIN_FILENO);
+				close(prev_read);
+			}
+			dup2(pipe_fds[1], STDOUT_FILENO);
+			close(pipe_fds[1]);
+			close(pipe_fds[0]);
+
+			exec_reset_signals();
+
+			run_flags stage_flags = copy_flags(flags);
+			stage_flags.in_child = 1;
+			int result = eval_child(stages[i], &stage_flags);
+			exit(result);
+		}
+
+		// Parent - keep only the read end for the next stage
+		child_track(pid);
+		pids[started++] = pid;
+		if (prev_read >= 0) {
+			close(prev_read);
+		}
+		close(pipe_fds[1]);
+		prev_read = pipe_fds[0];
+	}
+
+	// Last stage runs in the shell (lastpipe), so builtins keep side effects
+	int result = -1;
+	if (started == count - 1) {
+		result = eval_last_stage(stages[count - 1], prev_read, flags);
+	} else if (prev_read >= 0) {
+		close(prev_read);
+	}
+
+	// Wait for every stage by PID; last stage determines the result
+	for (uint32_t i = 0; i < started; i++) {
+		child_collect(pids[i]);
+	}
+
+	return result;
+}
+
+/**
+ * @brief Evaluate final pipeline stage in the shell process.
+ *
+ * @param[in] stage - Final stage.
+ * @param[in] fd_in - Read end of the previous pipe (closed on return).
+ * @param[in] flags - Run flags.
+ * @return Evaluation result.
+ */
+static int eval_last_stage(ast_node *stage, int fd_in, run_flags *flags) {
+	int saved_stdin = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+	if (saved_stdin < 0) {
+		close(fd_in);
 		return -1;
 	}
 
-	// Redirect left commmand's output to the write end
-	run_flags left_flags = copy_flags(flags);
-	redir output = {
-		.type = RDR_FD,
-		.flags = 0,
-		.from = STDOUT_FILENO,
-		.to.fd = pipe_fds[1],
-	};
-	vec_push(&left_flags.redirs, &output);
-	eval_child(pipeline->left, &left_flags);
-	close(pipe_fds[1]);
-	del_flags(&left_flags);
-
-	// Redirect read end to right command's input
-	run_flags right_flags = copy_flags(flags);
-	redir input = {
-		.type = RDR_FD,
-		.flags = 0,
-		.from = STDIN_FILENO,
-		.to.fd = pipe_fds[0],
-	};
-	vec_push(&right_flags.redirs, &input);
+	dup2(fd_in, STDIN_FILENO);
+	close(fd_in);
+
+	// Replacing the shell would leave earlier stages unwaited
+	int in_child = flags->in_child;
+	flags->in_child = 0;
+	int result = eval_child(stage, flags);
+	flags->in_child = in_child;
+
+	// Drops the last pipe reference, earlier stages see EOF or SIGPIPE
+	dup2(saved_stdin, STDIN_FILENO);
+	close(saved_stdin);
 
-	int result = eval_child(pipeline->right, &right_flags);
-	close(pipe_fds[0]);
-	del_flags(&right_flags);
 	return result;
 }
 
@@ -183,19 +350,16 @@ static int eval_pipe(ast_node *pipeline, run_flags *flags) {
  * @return Evaluation result.
  */
 static int eval_run(ast_node *run, run_flags *flags) {
-	ast_run_value type = run->value.run;
+	const ast_command *cmd = run->value.cmd;
 
-	if (type == AST_RUN_APPLY) {
-		to_flags(run->left, flags);
-		return eval_run(run->right, flags);
-	}
-	if (type == AST_RUN_SHELL_ENV) {
+	// Assignments only - these modify the shell itself
+	if (cmd->word_count == 0) {
 		run_flags set_var_flags = {
 			.redirs = vec_init(sizeof(redir)),
 			.assigns = vec_init(sizeof(assign)),
 		};
 
-		to_flags(run->left, &set_var_flags);
+		to_flags(cmd, &set_var_flags);
 		for (uint32_t i = 0; i < set_var_flags.assigns.count; i++) {
 			const assign *var_assign = vec_at(&set_var_flags.assigns, i);
 			vars_set(var_assign->key, var_assign->value);
@@ -206,153 +370,53 @@ static int eval_run(ast_node *run, run_flags *flags) {
 		return 0;
 	}
 
-	string_vector *argv = to_argv(run->left);
+	to_flags(cmd, flags);
+
+	// Unexpanded words are borrowed from the tree
+	string_vector owned = vec_init(sizeof(char *));
+	string_vector *argv = to_argv(cmd, &owned);
 	int result = run_dispatch(argv, flags);
-	free_elements(argv);
+	free_elements(&owned);
+	vec_deinit(&owned);
 	vec_delete(argv);
 
 	return result;
 }
 
 /**
- * @brief Convert a command body into an argument vector.
+ * @brief Convert command words into an argument vector.
  *
- * @param[in] target - Command body root node.
+ * @param[in] cmd - Command.
+ * @param[in,out] owned - Receives arguments that must be freed.
  * @return Argument vector.
  */
-static string_vector *to_argv(ast_node *target) {
-	stack words = stack_init(sizeof(ast_node));
-
-	// Parser will always build the tree to the left
-	while (target->kind == AST_KIND_JOIN) {
-		stack_push(&words, target->right);
-		target = target->left;
-	}
-
-	// Left-most node
-	stack_push(&words, target);
-
-	// Now process to argv
+static string_vector *to_argv(const ast_command *cmd, string_vector *owned) {
 	string_vector *argv = vec_new(sizeof(char *));
-	ast_node buffer;
-	while (stack_pop(&words, &buffer) != STACK_STATUS_EMPTY) {
-		add_word_to_argv(&buffer, argv);
+	for (uint32_t i = 0; i < cmd->word_count; i++) {
+		expand_fields(cmd->words[i], argv, owned);
 	}
 
-	stack_deinit(&words);
 	return argv;
 }
 
-/**
- * @brief Extract data from a word AST node into the argument vector.
- *
- * @param[in] word - AST node.
- * @param[in,out] argv - Argument vector being constructed.
- */
-static void add_word_to_argv(ast_node *word, string_vector *argv) {
-	char *expanded = expand_word(word->value.str);
-
-	char_vector final_arg = vec_init(sizeof(char));
-
-	char *trav = expanded;
-	char ch;
-	quote_st quotes = Q_NONE;
-
-	while ((ch = *trav++) != '\0') {
-		switch (ch) {
-		case '\\':
-			ch = *trav++;
-			vec_push(&final_arg, &ch);
-			break;
-		case ' ': // fallthrough
-		case '\t':
-			if (final_arg.count == 0) {
-				break;
-			}
-
-			if (quotes == Q_NONE) {
-				vec_push(&final_arg, &null_char);
-				char *arg = vec_collect(&final_arg);
-				vec_push(argv, &arg);
-			} else {
-				vec_push(&final_arg, &ch);
-			}
-			break;
-		case '\"':
-			switch (quotes) {
-			case Q_NONE:
-				quotes = Q_DOUBLE;
-				break;
-			case Q_DOUBLE:
-				quotes = Q_NONE;
-				break;
-			case Q_SINGLE:
-				vec_push(&final_arg, &ch);
-				break;
-			}
-			break;
-		case '\'':
-			switch (quotes) {
-			case Q_NONE:
-				quotes = Q_SINGLE;
-				break;
-			case Q_SINGLE:
-				quotes = Q_NONE;
-				break;
-			case Q_DOUBLE:
-				vec_push(&final_arg, &ch);
-				break;
-			}
-			break;
-		default:
-			vec_push(&final_arg, &ch);
-			break;
-		}
-	}
-
-	if (final_arg.count != 0) {
-		vec_push(&final_arg, &null_char);
-		char *arg = vec_collect(&final_arg);
-		vec_push(argv, &arg);
-	}
-
-	free(expanded);
-}
-
 /**
  * @brief Apply redirections and assignments to flags.
  *
- * @param[in] apply - Apply root node.
+ * @param[in] cmd - Command.
  * @param[in,out] flags - Flags to populate.
  */
-static void to_flags(ast_node *apply, run_flags *flags) {
-	stack words = stack_init(sizeof(ast_node));
-
-	// Parser will always build the tree to the left
-	while (apply->kind == AST_KIND_JOIN) {
-		stack_push(&words, apply->right);
-		apply = apply->left;
+static void to_flags(const ast_command *cmd, run_flags *flags) {
+	for (uint32_t i = 0; i < cmd->assign_count; i++) {
+		add_assign_to_flags(cmd->assigns[i], flags);
 	}
-
-	// Left-most node
-	stack_push(&words, apply);
-
-	// Now process to flags
-	ast_node buffer;
-	while (stack_pop(&words, &buffer) != STACK_STATUS_EMPTY) {
-		if (buffer.kind == AST_KIND_RDR) {
-			add_redir_to_flags(&buffer, flags);
-		} else if (buffer.kind == AST_KIND_ASSIGN) {
-			add_assign_to_flags(&buffer, flags);
-		}
+	for (uint32_t i = 0; i < cmd->redir_count; i++) {
+		add_redir_to_flags(cmd->redirs[i], flags);
 	}
-
-	stack_deinit(&words);
 }
 
-static void add_redir_to_flags(ast_node *rdr, run_flags *flags) {
+static void add_redir_to_flags(const ast_node *rdr, run_flags *flags) {
 	int fd_from = rdr->left->value.fdnum;
-	char *str_to = rdr->right->value.str;
+	const char *str_to = rdr->right->value.str;
 
 	int fd_to;
 	if (rdr->value.rdr == AST_RDR_O_DUP || rdr->value.rdr == AST_RDR_I_DUP) {
@@ -437,15 +501,14 @@ static void add_redir_to_flags(ast_node *rdr, run_flags *flags) {
 	vec_push(&flags->redirs, &new_redir);
 }
 
-static void add_assign_to_flags(ast_node *node, run_flags *flags) {
-	char *assign_str = node->value.str;
-
-	char *key = strtok(assign_str, "=");
-	char *value = strtok(NULL, "=");
+static void add_assign_to_flags(const ast_node *node, run_flags *flags) {
+	// Token text belongs to the tree, so split without modifying it
+	const char *assign_str = node->value.str;
+	const char *equals = strchr(assign_str, '=');
 
 	assign new_assign = {
-		.key = key,
-		.value = expand_word(value),
+		.key = strndup(assign_str, equals - assign_str),
+		.value = expand_word(equals + 1),
 	};
 	vec_push(&flags->assigns, &new_assign);
 }
@@ -9,6 +9,7 @@
 #pragma once
 
 #include "../grammar/ast.h"
+#include "flags.h"
 
 /**
  * @brief Evaluate an AST.
@@ -17,3 +18,20 @@
  * @return Evaluation result.
  */
 int eval_ast(ast_node *root);
+
+/**
+ * @brief Evaluate an AST with extra run flags.
+ *
+ * @param[in] root - AST root.
+ * @param[in] flags - Run flags; only used if root is not a sequence.
+ * @return Evaluation result.
+ */
+int eval_ast_flags(ast_node *root, run_flags *flags);
+
+/**
+ * @brief Check if an AST is a single built-in that leaves shell state alone.
+ *
+ * @param[in] root - AST root.
+ * @return Boolean result.
+ */
+int eval_is_pure(const ast_node *root);
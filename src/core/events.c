@@ -0,0 +1,209 @@
+/**
+ * @file core/events.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Shell event loop.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "events.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#define HAVE_EPOLL
+#endif
+
+#define MAX_EVENTS 16
+
+static int active = 0;
+
+#ifdef HAVE_EPOLL
+
+static int epoll_fd = -1;
+static int signal_fd = -1;
+// Signals read through signal_fd
+static sigset_t handled;
+// Mask before events_init
+static sigset_t saved_mask;
+
+static int drain_signals(void);
+
+int events_init(void) {
+	sigemptyset(&handled);
+	sigaddset(&handled, SIGINT);
+	sigaddset(&handled, SIGQUIT);
+	sigaddset(&handled, SIGCHLD);
+
+	if (sigprocmask(SIG_BLOCK, &handled, &saved_mask) < 0) {
+		return -1;
+	}
+
+	signal_fd = signalfd(-1, &handled, SFD_NONBLOCK | SFD_CLOEXEC);
+	epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+	if (signal_fd < 0 || epoll_fd < 0) {
+		events_deinit();
+		return -1;
+	}
+
+	struct epoll_event event = {
+		.events = EPOLLIN,
+		.data.fd = signal_fd,
+	};
+	if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &event) < 0) {
+		events_deinit();
+		return -1;
+	}
+
+	active = 1;
+	return 0;
+}
+
+void events_deinit(void) {
+	if (signal_fd >= 0) {
+		close(signal_fd);
+		signal_fd = -1;
+	}
+	if (epoll_fd >= 0) {
+		close(epoll_fd);
+		epoll_fd = -1;
+	}
+
+	if (active) {
+		sigprocmask(SIG_SETMASK, &saved_mask, NULL);
+		active = 0;
+	}
+}
+
+void events_child_mask(sigset_t *mask) {
+	if (active) {
+		*mask = saved_mask;
+	} else {
+		sigprocmask(SIG_SETMASK, NULL, mask);
+	}
+}
+
+void events_watch_child(int pidfd) {
+	if (!active || pidfd < 0) {
+		return;
+	}
+
+	// Edge triggered - exited children stay readable until forgotten
+	struct epoll_event event = {
+		.events = EPOLLIN | EPOLLET,
+		.data.fd = pidfd,
+	};
+	epoll_ctl(epoll_fd, EPOLL_CTL_ADD, pidfd, &event);
+}
+
+void events_unwatch_child(int pidfd) {
+	if (!active || pidfd < 0) {
+		return;
+	}
+
+	epoll_ctl(epoll_fd, EPOLL_CTL_DEL, pidfd, NULL);
+}
+
+int events_wait(int input_fd, int timeout) {
+	if (!active) {
+		return -1;
+	}
+
+	// Input is only watched while someone is waiting for it
+	if (input_fd >= 0) {
+		struct epoll_event event = {
+			.events = EPOLLIN,
+			.data.fd = input_fd,
+		};
+		if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, input_fd, &event) < 0) {
+			return -1;
+		}
+	}
+
+	struct epoll_event ready[MAX_EVENTS];
+	int count = epoll_wait(epoll_fd, ready, MAX_EVENTS, timeout);
+
+	if (input_fd >= 0) {
+		epoll_ctl(epoll_fd, EPOLL_CTL_DEL, input_fd, NULL);
+	}
+
+	if (count < 0) {
+		return (errno == EINTR) ? 0 : -1;
+	}
+
+	int result = 0;
+	for (int i = 0; i < count; i++) {
+		int fd = ready[i].data.fd;
+		if (fd == signal_fd) {
+			result |= drain_signals();
+		} else if (fd == input_fd) {
+			result |= EVENT_INPUT;
+		} else {
+			result |= EVENT_CHILD;
+		}
+	}
+
+	return result;
+}
+
+/** Internal */
+
+/**
+ * @brief Read all pending signals.
+ *
+ * @return EVENT_* mask.
+ */
+static int drain_signals(void) {
+	int result = 0;
+
+	struct signalfd_siginfo info;
+	while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+		if (info.ssi_signo == SIGCHLD) {
+			result |= EVENT_CHILD;
+		} else {
+			result |= EVENT_INTERRUPT;
+		}
+	}
+
+	return result;
+}
+
+#else
+
+// Fallback - signals are ignored and waits block
+
+int events_init(void) {
+	return -1;
+}
+
+void events_deinit(void) {
+}
+
+void events_child_mask(sigset_t *mask) {
+	sigprocmask(SIG_SETMASK, NULL, mask);
+}
+
+void events_watch_child(int pidfd) {
+	(void)pidfd;
+}
+
+void events_unwatch_child(int pidfd) {
+	(void)pidfd;
+}
+
+int events_wait(int input_fd, int timeout) {
+	(void)input_fd;
+	(void)timeout;
+	return -1;
+}
+
+#endif
+
+int events_active(void) {
+	return active;
+}
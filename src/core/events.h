@@ -0,0 +1,68 @@
+/**
+ * @file core/events.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Shell event loop.
+ */
+#pragma once
+
+#include <signal.h>
+
+// Results of events_wait
+#define EVENT_CHILD 0x1
+#define EVENT_INPUT 0x2
+#define EVENT_INTERRUPT 0x4
+
+/**
+ * @brief Take over signal delivery and start the event loop.
+ *
+ * @return 0 on success; -1 if not supported.
+ * @note SIGINT, SIGQUIT and SIGCHLD are blocked and read from the loop.
+ */
+int events_init(void);
+
+/**
+ * @brief Stop the event loop and restore the signal mask.
+ *
+ * @note Used in forked children; they must not share the loop.
+ */
+void events_deinit(void);
+
+/**
+ * @brief Check if the event loop is running.
+ *
+ * @return Boolean result.
+ */
+int events_active(void);
+
+/**
+ * @brief Get the signal mask new programs should start with.
+ *
+ * @param[out] mask - Signal mask.
+ */
+void events_child_mask(sigset_t *mask);
+
+/**
+ * @brief Watch a child process file descriptor.
+ *
+ * @param[in] pidfd - Process file descriptor.
+ */
+void events_watch_child(int pidfd);
+
+/**
+ * @brief Stop watching a child process file descriptor.
+ *
+ * @param[in] pidfd - Process file descriptor.
+ */
+void events_unwatch_child(int pidfd);
+
+/**
+ * @brief Wait for events.
+ *
+ * @param[in] input_fd - Input to wait on; -1 for none.
+ * @param[in] timeout - Timeout in milliseconds; -1 for none.
+ * @return EVENT_* mask; 0 on timeout; -1 on error.
+ */
+int events_wait(int input_fd, int timeout);
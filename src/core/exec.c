@@ -4,7 +4,7 @@
  * @version 0.3.0
  * @date 2023-2024
  * @license GPLv3.0
- * @brief Execute external programs with fork.
+ * @brief Execute external programs with posix_spawn or fork.
  */
 #define _POSIX_C_SOURCE 200809L
 #include "exec.h"
@@ -12,22 +12,56 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
-#include <sys/wait.h>
 #include <unistd.h>
 
 #include "../util/error.h"
+#include "../util/helper.h"
+#include "child.h"
+#include "eval.h"
+#include "events.h"
 #include "flags.h"
+#include "path.h"
 #include "vars.h"
 
-// from main.c
-extern void run_from_stream(const FILE *stream);
+// Runs executables that are not binaries and have no '#!' line
+#define SCRIPT_SHELL "/bin/sh"
+
+static int spawn_process(
+	const char *file, char **argv, const run_flags *flags, pid_t *pid);
+static int has_path_assign(const run_flags *flags);
+static int has_fd_conflict(const run_flags *flags, const int *opened);
+static char **export_with_assigns(const assign_vector *assigns, char **owned);
+static void free_env(char **env, char **owned, uint32_t count);
+static char **script_argv(const char *file, char **argv);
 
 int exec_normal(char **argv, const run_flags *flags) {
-	pid_t pid = fork();
+	// Resolve in the parent, unless PATH is set only for this command
+	const char *file = argv[0];
+	if (!has_path_assign(flags)) {
+		file = path_resolve(argv[0]);
+		if (file == NULL) {
+			print_error("%s: command not found\n", argv[0]);
+			return 1;
+		}
+	}
+
+	// Fast path - avoid copying the shell's page tables
+	pid_t pid;
+	int spawn_res = spawn_process(file, argv, flags, &pid);
+	if (spawn_res < 0) {
+		return 1;
+	}
+	if (spawn_res == 0) {
+		child_track(pid);
+		return child_collect(pid);
+	}
+
+	pid = fork();
 
 	if (pid < 0) {
 		// Fork failed
@@ -35,34 +69,96 @@ int exec_normal(char **argv, const run_flags *flags) {
 		return -1;
 	} else if (pid == 0) {
 		// Child - prepare and exec
-		if (apply_flags(flags) < 0) {
-			print_error("failed to perform redirections\n");
-			exit(1);
-		}
+		exec_replace(argv, flags);
+	} else {
+		// Parent - wait
+		child_track(pid);
+		return child_collect(pid);
+	}
+}
+
+noreturn void exec_replace(char **argv, const run_flags *flags) {
+	if (apply_flags(flags) < 0) {
+		print_error("failed to perform redirections\n");
+		exit(1);
+	}
 
-		// Load environment
-		extern char **environ;
-		environ = vars_export();
+	// Load environment
+	extern char **environ;
+	environ = (char **)vars_export();
 
-		// TODO: proper signal reset
-		signal(SIGINT, SIG_DFL);
-		signal(SIGQUIT, SIG_DFL);
+	exec_reset_signals();
 
-		// Execute
-		execvp(argv[0], argv);
+	// Execute
+	const char *file = path_resolve(argv[0]);
+	if (file != NULL) {
+		exec_file(file, argv);
+	}
 
-		// Exec failed
-		print_error("%s: command not found\n", argv[0]);
-		exit(1);
-	} else {
-		// Parent - wait
-		int result;
-		wait(&result);
-		return WEXITSTATUS(result);
+	// Exec failed
+	print_error("%s: command not found\n", argv[0]);
+	exit(1);
+}
+
+void exec_file(const char *file, char **argv) {
+	execv(file, argv);
+
+	// Cached lookup went stale; search PATH again
+	if ((errno == ENOENT || errno == EACCES) && file != argv[0]
+		&& path_forget(argv[0])) {
+		file = path_resolve(argv[0]);
+		if (file == NULL) {
+			errno = ENOENT;
+			return;
+		}
+		execv(file, argv);
+	}
+
+	if (errno != ENOEXEC) {
+		return;
 	}
+
+	char **sh_argv = script_argv(file, argv);
+	execv(SCRIPT_SHELL, sh_argv);
+	free(sh_argv);
+}
+
+void exec_reset_signals(void) {
+	// TODO: proper signal reset
+	signal(SIGINT, SIG_DFL);
+	signal(SIGQUIT, SIG_DFL);
+	signal(SIGTTOU, SIG_DFL);
+
+	// Also unblocks signals owned by the event loop
+	events_deinit();
 }
 
 int exec_silent(char **argv) {
+	// Redirect stdout to /dev/null
+	redir null_out = {
+		.type = RDR_FILE,
+		.flags = O_WRONLY,
+		.from = STDOUT_FILENO,
+		.to.filename = "/dev/null",
+	};
+	run_flags flags = {
+		.redirs = vec_init(sizeof(redir)),
+		.assigns = vec_init(sizeof(assign)),
+	};
+	vec_push(&flags.redirs, &null_out);
+
+	int result = exec_normal(argv, &flags);
+	vec_deinit(&flags.redirs);
+	vec_deinit(&flags.assigns);
+
+	return result;
+}
+
+pid_t exec_subshell(ast_node *root, int fd_pipe_out) {
+	// Child will inherit unflushed buffers
+	fflush(stdout);
+	fflush(stderr);
+
 	pid_t pid = fork();
 
 	if (pid < 0) {
@@ -70,63 +166,288 @@ int exec_silent(char **argv) {
 		print_error("failed to create new process\n");
 		return -1;
 	} else if (pid == 0) {
-		// Child - load environment and exec
-		extern char **environ;
-		environ = vars_export();
+		// Redirect stdout to pipe
+		dup2(fd_pipe_out, STDOUT_FILENO);
+		close(fd_pipe_out);
+		exec_reset_signals();
+
+		run_flags flags = {
+			.redirs = vec_init(sizeof(redir)),
+			.assigns = vec_init(sizeof(assign)),
+			// Simple commands can replace the subshell
+			.in_child = (root->kind == AST_KIND_RUN),
+		};
+
+		int result = eval_ast_flags(root, &flags);
+		fflush(stdout);
+		exit(result);
+	}
+
+	// Parent - caller reads output before waiting
+	child_track(pid);
+	return pid;
+}
+
+/** Internal */
+
+/**
+ * @brief Start a process with posix_spawn.
+ *
+ * @param[in] file - Executable path or name to search in PATH.
+ * @param[in] argv - Child arguments.
+ * @param[in] flags - Special run flags.
+ * @param[out] pid - Child PID on success.
+ * @return 0 on success; 1 if fork must be used instead; -1 on error.
+ */
+static int spawn_process(
+	const char *file, char **argv, const run_flags *flags, pid_t *pid) {
+	uint32_t redir_count = flags->redirs.count;
+
+	char *owned[flags->assigns.count + 1];
+
+	// Open files in the parent, so open errors are not mistaken for exec errors
+	int opened[redir_count + 1];
+	for (uint32_t i = 0; i < redir_count; i++) {
+		const redir *op = vec_at(&flags->redirs, i);
+
+		opened[i] = -1;
+		if (op->type != RDR_FILE) {
+			continue;
+		}
+
+		opened[i] = open(op->to.filename, op->flags | O_CLOEXEC, 0644);
+		if (opened[i] < 0) {
+			print_error("failed to perform redirections\n");
+			for (uint32_t j = 0; j < i; j++) {
+				if (opened[j] >= 0) {
+					close(opened[j]);
+				}
+			}
+
+			return -1;
+		}
+	}
+
+	int result = 1;
+	if (has_fd_conflict(flags, opened)) {
+		goto close_opened;
+	}
+
+	// Translate redirections into file actions
+	posix_spawn_file_actions_t actions;
+	posix_spawn_file_actions_init(&actions);
+	for (uint32_t i = 0; i < redir_count; i++) {
+		const redir *op = vec_at(&flags->redirs, i);
+
+		switch (op->type) {
+		case RDR_FD:
+			posix_spawn_file_actions_adddup2(&actions, op->to.fd, op->from);
+			break;
+		case RDR_FILE:
+			posix_spawn_file_actions_adddup2(&actions, opened[i], op->from);
+			break;
+		case RDR_CLOSE:
+			posix_spawn_file_actions_addclose(&actions, op->from);
+			break;
+		}
+	}
+
+	// Child gets default signal handling
+	posix_spawnattr_t attr;
+	posix_spawnattr_init(&attr);
 
-		// TODO: proper signal reset
-		signal(SIGINT, SIG_DFL);
-		signal(SIGQUIT, SIG_DFL);
+	sigset_t default_set;
+	sigemptyset(&default_set);
+	sigaddset(&default_set, SIGINT);
+	sigaddset(&default_set, SIGQUIT);
+	sigaddset(&default_set, SIGTTOU);
+	posix_spawnattr_setsigdefault(&attr, &default_set);
 
-		// Redirect stdout to /dev/null
-		int null_fd = open("/dev/null", 0);
-		close(STDOUT_FILENO);
-		dup2(null_fd, STDOUT_FILENO);
+	sigset_t child_mask;
+	events_child_mask(&child_mask);
+	posix_spawnattr_setsigmask(&attr, &child_mask);
+	posix_spawnattr_setflags(
+		&attr, POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK);
 
-		// Execute
-		execvp(argv[0], argv);
+	// posix_spawnp searches the caller's PATH, so swap the environment
+	extern char **environ;
+	char **env = export_with_assigns(&flags->assigns, owned);
+	char **saved_environ = environ;
+	environ = env;
+
+	int spawn_res = posix_spawnp(pid, file, &actions, &attr, argv, env);
+	if ((spawn_res == ENOENT || spawn_res == EACCES) && file != argv[0]
+		&& path_forget(argv[0])) {
+		// Cached lookup went stale; search PATH again
+		file = path_resolve(argv[0]);
+		if (file != NULL) {
+			spawn_res = posix_spawnp(pid, file, &actions, &attr, argv, env);
+		}
+	}
+	if (spawn_res == ENOEXEC) {
+		// No '#!' line, same fallback as exec_file
+		char **sh_argv = script_argv(file, argv);
+		spawn_res =
+			posix_spawn(pid, SCRIPT_SHELL, &actions, &attr, sh_argv, env);
+		free(sh_argv);
+	}
+	environ = saved_environ;
 
-		// Exec failed
+	if (spawn_res == 0) {
+		result = 0;
+	} else if (spawn_res == ENOENT) {
 		print_error("%s: command not found\n", argv[0]);
-		exit(1);
+		result = -1;
 	} else {
-		// Parent - wait
-		int result;
-		wait(&result);
-		return WEXITSTATUS(result);
+		print_error("%s: %s\n", argv[0], strerror(spawn_res));
+		result = -1;
 	}
+
+	free_env(env, owned, flags->assigns.count);
+	posix_spawnattr_destroy(&attr);
+	posix_spawn_file_actions_destroy(&actions);
+
+close_opened:
+	for (uint32_t i = 0; i < redir_count; i++) {
+		if (opened[i] >= 0) {
+			close(opened[i]);
+		}
+	}
+
+	return result;
 }
 
-int exec_subshell(const char *cmd, int fd_pipe_out) {
-	pid_t pid = fork();
+/**
+ * @brief Check if PATH is assigned for this command only.
+ *
+ * @param[in] flags - Special run flags.
+ * @return Boolean result.
+ */
+static int has_path_assign(const run_flags *flags) {
+	for (uint32_t i = 0; i < flags->assigns.count; i++) {
+		const assign *op = vec_at(&flags->assigns, i);
+		if (strcmp(op->key, "PATH") == 0) {
+			return 1;
+		}
+	}
 
-	if (pid < 0) {
-		// Fork failed
-		print_error("failed to create new process\n");
-		return -1;
-	} else if (pid == 0) {
-		// Redirect stdin to pipe
-		int stdin_pipe[2];
-		if (pipe(stdin_pipe) < 0) {
-			return -1;
+	return 0;
+}
+
+/**
+ * @brief Check if a file opened by the parent is clobbered by a redirection.
+ *
+ * @param[in] flags - Special run flags.
+ * @param[in] opened - File descriptors opened for each redirection.
+ * @return Boolean result.
+ */
+static int has_fd_conflict(const run_flags *flags, const int *opened) {
+	for (uint32_t i = 0; i < flags->redirs.count; i++) {
+		if (opened[i] < 0) {
+			continue;
 		}
-		close(STDIN_FILENO);
-		dup2(stdin_pipe[0], STDIN_FILENO);
 
-		// Write command to stdin
-		write(stdin_pipe[1], cmd, strlen(cmd));
-		close(stdin_pipe[1]);
+		for (uint32_t j = 0; j < flags->redirs.count; j++) {
+			const redir *op = vec_at(&flags->redirs, j);
+			if (op->from == opened[i]) {
+				return 1;
+			}
+			if (op->type == RDR_FD && op->to.fd == opened[i]) {
+				return 1;
+			}
+		}
+	}
 
-		// Redirect stdout to pipe
-		close(STDOUT_FILENO);
-		dup2(fd_pipe_out, STDOUT_FILENO);
+	return 0;
+}
 
-		run_from_stream(stdin);
-		exit(0);
-	} else {
-		// Parent - wait
-		int result;
-		wait(&result);
-		return WEXITSTATUS(result);
+/**
+ * @brief Export environment with command assignments applied.
+ *
+ * @param[in] assigns - Assignments for this command.
+ * @param[out] owned - Receives an allocated entry for every assignment.
+ * @return Null-terminated list of environment vars.
+ * @note Return value is allocated only if there are assignments.
+ */
+static char **export_with_assigns(const assign_vector *assigns, char **owned) {
+	char **exported = (char **)vars_export();
+	if (assigns->count == 0) {
+		return exported;
+	}
+
+	uint32_t count = 0;
+	while (exported[count] != NULL) {
+		count++;
+	}
+
+	char **env = ntmalloc(count + assigns->count, sizeof(char *));
+	memcpy(env, exported, count * sizeof(char *));
+
+	for (uint32_t i = 0; i < assigns->count; i++) {
+		const assign *op = vec_at(assigns, i);
+		size_t key_len = strlen(op->key);
+
+		char *entry = malloc(key_len + strlen(op->value) + 2);
+		sprintf(entry, "%s=%s", op->key, op->value);
+		owned[i] = entry;
+
+		// Replace existing entry or append
+		uint32_t j;
+		for (j = 0; j < count; j++) {
+			if (strncmp(env[j], op->key, key_len) == 0
+				&& env[j][key_len] == '=') {
+				break;
+			}
+		}
+
+		if (j == count) {
+			count++;
+		}
+		env[j] = entry;
 	}
+
+	env[count] = NULL;
+	return env;
+}
+
+/**
+ * @brief Free an environment list made by export_with_assigns.
+ *
+ * @param[in] env - Null-terminated list of environment vars.
+ * @param[in] owned - Allocated assignment entries.
+ * @param[in] count - Assignment count.
+ */
+static void free_env(char **env, char **owned, uint32_t count) {
+	if (count == 0) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		free(owned[i]);
+	}
+
+	free(env);
+}
+
+/**
+ * @brief Build arguments for running a file through SCRIPT_SHELL.
+ *
+ * @param[in] file - Script path.
+ * @param[in] argv - Null-terminated original arguments.
+ * @return Null-terminated arguments.
+ * @note Allocated return value (strings are borrowed).
+ */
+static char **script_argv(const char *file, char **argv) {
+	size_t argc = 0;
+	while (argv[argc] != NULL) {
+		argc++;
+	}
+
+	// sh, file, then everything after argv[0] including the terminator
+	char **sh_argv = malloc((argc + 2) * sizeof(char *));
+	sh_argv[0] = "sh";
+	sh_argv[1] = (char *)file;
+	memcpy(sh_argv + 2, argv + 1, argc * sizeof(char *));
+
+	return sh_argv;
 }
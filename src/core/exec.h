@@ -4,10 +4,13 @@
  * @version 0.3.0
  * @date 2023-2024
  * @license GPLv3.0
- * @brief Execute external programs with fork.
+ * @brief Execute external programs with posix_spawn or fork.
  */
 #pragma once
 
+#include <sys/types.h>
+
+#include "../grammar/ast.h"
 #include "run.h"
 
 /**
@@ -19,6 +22,31 @@
  */
 int exec_normal(char **argv, const run_flags *flags);
 
+/**
+ * @brief Exec wrapper for an already forked child.
+ *
+ * @param[in] argv - Child arguments.
+ * @param[in] flags - Special run flags.
+ * @note Does not return.
+ */
+noreturn void exec_replace(char **argv, const run_flags *flags);
+
+/**
+ * @brief Replace the process with a resolved executable.
+ *
+ * @param[in] file - Executable path.
+ * @param[in] argv - Null-terminated arguments.
+ * @note Files without a '#!' line are run by /bin/sh, like execvp does.
+ * @note A stale cached path for argv[0] is looked up again.
+ * @note Only returns on error.
+ */
+void exec_file(const char *file, char **argv);
+
+/**
+ * @brief Reset signal handling changed by the shell (for forked children).
+ */
+void exec_reset_signals(void);
+
 /**
  * @brief Exec wrapper with silenced output.
  *
@@ -28,10 +56,11 @@ int exec_normal(char **argv, const run_flags *flags);
 int exec_silent(char **argv);
 
 /**
- * @brief Command to run in a subshell.
+ * @brief Start evaluating parsed command in a subshell.
  *
- * @param[in] cmd - Command sent to stdin.
+ * @param[in] root - Parsed command.
  * @param[in] fd_pipe_out - Pipe to replace stdout with.
- * @return Return code.
+ * @return Child PID; -1 on error.
+ * @note Wait for the child with child_collect.
  */
-int exec_subshell(const char *cmd, int fd_pipe_out);
+pid_t exec_subshell(ast_node *root, int fd_pipe_out);
@@ -26,6 +26,7 @@ run_flags copy_flags(const run_flags *flags) {
 	run_flags new_flags = {
 		.redirs = vec_init_clone(&flags->redirs),
 		.assigns = vec_init_clone(&flags->assigns),
+		.in_child = flags->in_child,
 	};
 
 	return new_flags;
@@ -37,6 +38,7 @@ void del_flags(run_flags *flags) {
 	// I don't like this
 	for (uint32_t i = 0; i < flags->assigns.count; i++) {
 		const assign *item = vec_at(&flags->assigns, i);
+		free(item->key);
 		free(item->value);
 	}
 	vec_deinit(&flags->assigns);
@@ -18,7 +18,7 @@ typedef enum {
 
 typedef union {
 	int fd;
-	char *filename;
+	const char *filename;
 } redir_src;
 
 typedef struct {
@@ -41,6 +41,8 @@ typedef vector assign_vector;
 typedef struct {
 	redir_vector redirs;
 	assign_vector assigns;
+	// Already running in a forked child (exec without forking again)
+	int in_child;
 } run_flags;
 
 /**
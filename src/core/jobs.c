@@ -0,0 +1,332 @@
+/**
+ * @file core/jobs.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Background job table.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "jobs.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <c-utils/vector.h>
+
+#include "../util/error.h"
+#include "child.h"
+
+typedef vector job_vector;
+
+// Job table
+static job_vector *jobs = NULL;
+// Jobs get their own process group
+static int job_control = 0;
+static pid_t shell_pgid = 0;
+
+static const char *const state_names[] = {
+	[JOB_RUNNING] = "Running",
+	[JOB_STOPPED] = "Stopped",
+	[JOB_DONE] = "Done",
+};
+
+static int update_job(job *target, int options);
+static void remove_job(const job *target);
+static pid_t signal_target(const job *target);
+static int has_terminal(void);
+
+void jobs_init(void) {
+	job_control = 1;
+	shell_pgid = getpgrp();
+
+	// Needed to take the terminal back from a foreground job
+	signal(SIGTTOU, SIG_IGN);
+}
+
+void jobs_setup_child(void) {
+	if (job_control) {
+		setpgid(0, 0);
+	}
+}
+
+uint32_t jobs_add(pid_t pid) {
+	if (jobs == NULL) {
+		jobs = vec_new(sizeof(job));
+	}
+
+	// Set from both sides to avoid a race with the child
+	if (job_control) {
+		setpgid(pid, pid);
+	}
+
+	uint32_t id = 1;
+	if (jobs->count > 0) {
+		const job *last = vec_at(jobs, jobs->count - 1);
+		id = last->id + 1;
+	}
+
+	job new_job = {
+		.id = id,
+		.pid = pid,
+		.state = JOB_RUNNING,
+		.status = 0,
+	};
+	vec_push(jobs, &new_job);
+
+	if (job_control) {
+		fprintf(stderr, "[%u] %d\n", id, pid);
+	}
+
+	return id;
+}
+
+job *jobs_find(const char *spec) {
+	if (jobs == NULL || jobs->count == 0) {
+		return NULL;
+	}
+
+	// Current job is the most recent one
+	if (spec == NULL || strcmp(spec, "%%") == 0 || strcmp(spec, "%+") == 0) {
+		return vec_at_mut(jobs, jobs->count - 1);
+	}
+
+	int by_id = (spec[0] == '%');
+	char *end;
+	long value = strtol(spec + by_id, &end, 10);
+	if (*end != '\0' || end == spec + by_id) {
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < jobs->count; i++) {
+		job *entry = vec_at_mut(jobs, i);
+		if (by_id ? entry->id == value : entry->pid == value) {
+			return entry;
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t jobs_reap(void) {
+	if (jobs == NULL) {
+		return 0;
+	}
+
+	uint32_t finished = 0;
+	for (uint32_t i = 0; i < jobs->count; i++) {
+		job *entry = vec_at_mut(jobs, i);
+		if (entry->state == JOB_DONE) {
+			continue;
+		}
+
+		update_job(entry, CHILD_NOHANG | CHILD_UNTRACED);
+		if (entry->state == JOB_DONE) {
+			finished++;
+		}
+	}
+
+	return finished;
+}
+
+void jobs_print(int done_only) {
+	if (jobs == NULL) {
+		return;
+	}
+
+	jobs_reap();
+
+	uint32_t i = 0;
+	while (i < jobs->count) {
+		const job *entry = vec_at(jobs, i);
+		if (done_only && entry->state != JOB_DONE) {
+			i++;
+			continue;
+		}
+
+		printf("[%u] %s\t%d\n", entry->id, state_names[entry->state],
+			entry->pid);
+
+		// Finished jobs are only reported once
+		if (entry->state == JOB_DONE) {
+			vec_erase(jobs, i, NULL);
+		} else {
+			i++;
+		}
+	}
+
+	fflush(stdout);
+}
+
+void jobs_notify(void) {
+	if (job_control) {
+		jobs_print(1);
+		return;
+	}
+
+	if (jobs == NULL) {
+		return;
+	}
+
+	// Without job control, finished jobs are dropped silently
+	jobs_reap();
+
+	uint32_t i = 0;
+	while (i < jobs->count) {
+		const job *entry = vec_at(jobs, i);
+		if (entry->state == JOB_DONE) {
+			vec_erase(jobs, i, NULL);
+		} else {
+			i++;
+		}
+	}
+}
+
+int jobs_wait(job *target) {
+	while (target->state != JOB_DONE) {
+		if (update_job(target, 0) < 0) {
+			// Ctrl-C stops waiting; the job keeps running
+			if (errno == EINTR) {
+				return -1;
+			}
+			break;
+		}
+	}
+
+	int result = target->status;
+	remove_job(target);
+	return result;
+}
+
+int jobs_wait_all(void) {
+	while (jobs != NULL && jobs->count > 0) {
+		if (jobs_wait(vec_at_mut(jobs, 0)) < 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int jobs_foreground(job *target) {
+	int terminal = has_terminal();
+	if (terminal) {
+		tcsetpgrp(STDIN_FILENO, target->pid);
+	}
+
+	if (target->state == JOB_STOPPED) {
+		kill(signal_target(target), SIGCONT);
+		target->state = JOB_RUNNING;
+	}
+
+	while (target->state == JOB_RUNNING) {
+		// Job got the same SIGINT; wait for it to react
+		if (update_job(target, CHILD_UNTRACED) < 0 && errno != EINTR) {
+			break;
+		}
+	}
+
+	if (terminal) {
+		tcsetpgrp(STDIN_FILENO, shell_pgid);
+	}
+
+	if (target->state == JOB_STOPPED) {
+		printf("[%u] %s\t%d\n", target->id, state_names[target->state],
+			target->pid);
+		return 128 + SIGTSTP;
+	}
+
+	int result = target->status;
+	remove_job(target);
+	return result;
+}
+
+int jobs_background(job *target) {
+	if (target->state == JOB_DONE) {
+		print_error("job has already finished\n");
+		return -1;
+	}
+
+	if (kill(signal_target(target), SIGCONT) < 0) {
+		return -1;
+	}
+
+	target->state = JOB_RUNNING;
+	printf("[%u] %d\n", target->id, target->pid);
+	return 0;
+}
+
+/** Internal */
+
+/**
+ * @brief Wait for a job state change and update the job.
+ *
+ * @param[in,out] target - Job object.
+ * @param[in] options - Options for child_poll.
+ * @return 1 if state changed; 0 if not; -1 on error.
+ */
+static int update_job(job *target, int options) {
+	child_proc *proc = child_get(target->pid);
+	if (proc == NULL) {
+		errno = ECHILD;
+		return -1;
+	}
+
+	int res = child_poll(proc, options);
+	if (res <= 0) {
+		return res;
+	}
+
+	switch (proc->state) {
+	case CHILD_RUNNING:
+		target->state = JOB_RUNNING;
+		break;
+	case CHILD_STOPPED:
+		target->state = JOB_STOPPED;
+		break;
+	case CHILD_EXITED:
+		target->state = JOB_DONE;
+		target->status = child_result(proc);
+		child_forget(target->pid);
+		break;
+	}
+
+	return 1;
+}
+
+/**
+ * @brief Remove job from the table.
+ *
+ * @param[in] target - Job object (must be in the table).
+ */
+static void remove_job(const job *target) {
+	child_forget(target->pid);
+
+	const job *first = vec_at(jobs, 0);
+	vec_erase(jobs, target - first, NULL);
+}
+
+/**
+ * @brief Get the process ID for signalling the whole job.
+ *
+ * @param[in] target - Job object.
+ * @return Process (group) ID for kill.
+ */
+static pid_t signal_target(const job *target) {
+	return job_control ? -target->pid : target->pid;
+}
+
+/**
+ * @brief Check if the shell controls a terminal.
+ *
+ * @return Boolean result.
+ */
+static int has_terminal(void) {
+	return job_control && isatty(STDIN_FILENO);
+}
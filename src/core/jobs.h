@@ -0,0 +1,102 @@
+/**
+ * @file core/jobs.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Background job table.
+ */
+#pragma once
+
+#include <stdint.h>
+#include <sys/types.h>
+
+typedef enum {
+	JOB_RUNNING,
+	JOB_STOPPED,
+	JOB_DONE,
+} job_state;
+
+typedef struct {
+	uint32_t id;
+	pid_t pid;
+	job_state state;
+	int status;
+} job;
+
+/**
+ * @brief Enable job control (interactive shell).
+ */
+void jobs_init(void);
+
+/**
+ * @brief Prepare a forked child that will run as a background job.
+ */
+void jobs_setup_child(void);
+
+/**
+ * @brief Add a background job to the table.
+ *
+ * @param[in] pid - Job process ID.
+ * @return Job ID.
+ */
+uint32_t jobs_add(pid_t pid);
+
+/**
+ * @brief Find a job by specification.
+ *
+ * @param[in] spec - '%n', '%%', '%+' or process ID; NULL for current job.
+ * @return Job object; NULL if not found.
+ */
+job *jobs_find(const char *spec);
+
+/**
+ * @brief Update job states without blocking.
+ *
+ * @return Number of jobs that finished.
+ */
+uint32_t jobs_reap(void);
+
+/**
+ * @brief Print job table and forget finished jobs.
+ *
+ * @param[in] done_only - Only print jobs that finished.
+ */
+void jobs_print(int done_only);
+
+/**
+ * @brief Reap finished jobs and remove them; they are reported only with
+ * job control.
+ */
+void jobs_notify(void);
+
+/**
+ * @brief Wait for a job to finish and remove it from the table.
+ *
+ * @param[in] target - Job object.
+ * @return Job exit status; -1 if interrupted (job is kept).
+ */
+int jobs_wait(job *target);
+
+/**
+ * @brief Wait for all jobs to finish.
+ *
+ * @return 0 on success; -1 if interrupted.
+ */
+int jobs_wait_all(void);
+
+/**
+ * @brief Continue a job in the foreground and wait for it.
+ *
+ * @param[in] target - Job object.
+ * @return Job exit status.
+ */
+int jobs_foreground(job *target);
+
+/**
+ * @brief Continue a stopped job in the background.
+ *
+ * @param[in] target - Job object.
+ * @return 0 on success; -1 on failure.
+ */
+int jobs_background(job *target);
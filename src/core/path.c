@@ -0,0 +1,182 @@
+/**
+ * @file core/path.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Cached command lookup in PATH.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "path.h"
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <c-utils/vector.h>
+
+#include "../util/fs.h"
+#include "../util/hashmap.h"
+#include "vars.h"
+
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+typedef struct {
+	char *path;
+	uint32_t hits;
+} cached_cmd;
+
+typedef vector str_vector;
+
+// Command name -> cached_cmd
+static hashmap cache;
+// Parsed PATH directories; NULL if not loaded
+static str_vector *dirs = NULL;
+// Result storage for commands that are not cached
+static char uncached_path[PATH_MAX];
+
+static void load_dirs(void);
+static const char *search(const char *name);
+static void free_cached(void *entry);
+
+const char *path_resolve(const char *name) {
+	if (strchr(name, '/') != NULL) {
+		return name;
+	}
+
+	if (dirs == NULL) {
+		load_dirs();
+	}
+
+	// Hits are not checked here; exec reports stale entries with path_forget
+	cached_cmd *entry = hashmap_get(&cache, name);
+	if (entry != NULL) {
+		entry->hits++;
+		return entry->path;
+	}
+
+	return search(name);
+}
+
+int path_forget(const char *name) {
+	cached_cmd *entry = hashmap_remove(&cache, name);
+	if (entry == NULL) {
+		return 0;
+	}
+
+	free_cached(entry);
+	return 1;
+}
+
+void path_invalidate(void) {
+	hashmap_clear(&cache, &free_cached);
+
+	if (dirs != NULL) {
+		for (uint32_t i = 0; i < dirs->count; i++) {
+			char *const *dir = vec_at(dirs, i);
+			free(*dir);
+		}
+
+		vec_delete(dirs);
+		dirs = NULL;
+	}
+}
+
+void path_print(void) {
+	if (cache.count == 0) {
+		printf("hash: hash table empty\n");
+		return;
+	}
+
+	printf("hits\tcommand\n");
+
+	uint32_t iter = 0;
+	const hashmap_slot *slot;
+	while ((slot = hashmap_next(&cache, &iter)) != NULL) {
+		const cached_cmd *entry = slot->value;
+		printf("%4u\t%s\n", entry->hits, entry->path);
+	}
+}
+
+/** Internal */
+
+/**
+ * @brief Split PATH into directories.
+ */
+static void load_dirs(void) {
+	const char *path_var = vars_get("PATH");
+	if (path_var == NULL) {
+		path_var = DEFAULT_PATH;
+	}
+
+	dirs = vec_new(sizeof(char *));
+
+	const char *start = path_var;
+	while (1) {
+		const char *end = strchr(start, ':');
+		size_t length = (end == NULL) ? strlen(start) : (size_t)(end - start);
+
+		// Empty entry means current directory
+		char *dir = (length == 0) ? strdup(".") : strndup(start, length);
+		vec_push(dirs, &dir);
+
+		if (end == NULL) {
+			break;
+		}
+		start = end + 1;
+	}
+}
+
+/**
+ * @brief Walk PATH directories looking for an executable.
+ *
+ * @param[in] name - Command name.
+ * @return Executable path; NULL if not found.
+ */
+static const char *search(const char *name) {
+	for (uint32_t i = 0; i < dirs->count; i++) {
+		const char *dir = *(char *const *)vec_at(dirs, i);
+		if (strlen(dir) + strlen(name) + 2 > PATH_MAX) {
+			continue;
+		}
+
+		strcpy(uncached_path, dir);
+		fs_path_cat(uncached_path, name);
+
+		struct stat file_info;
+		if (stat(uncached_path, &file_info) < 0
+			|| !S_ISREG(file_info.st_mode)
+			|| access(uncached_path, X_OK) < 0) {
+			continue;
+		}
+
+		// Relative directories depend on the working directory
+		if (dir[0] != '/') {
+			return uncached_path;
+		}
+
+		cached_cmd *entry = malloc(sizeof(cached_cmd));
+		entry->path = strdup(uncached_path);
+		entry->hits = 1;
+		hashmap_set(&cache, name, entry);
+
+		return entry->path;
+	}
+
+	return NULL;
+}
+
+/**
+ * @brief Free cache entry.
+ *
+ * @param[in] entry - Cache entry.
+ */
+static void free_cached(void *entry) {
+	cached_cmd *cmd = entry;
+	free(cmd->path);
+	free(cmd);
+}
@@ -0,0 +1,39 @@
+/**
+ * @file core/path.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Cached command lookup in PATH.
+ */
+#pragma once
+
+/**
+ * @brief Resolve command name to an executable path.
+ *
+ * @param[in] name - Command name.
+ * @return Executable path; NULL if not found.
+ * @note Names containing a slash are returned as is.
+ * @note Result is valid until the next call.
+ */
+const char *path_resolve(const char *name);
+
+/**
+ * @brief Drop a cached lookup that turned out to be stale.
+ *
+ * @param[in] name - Command name.
+ * @return 1 if an entry was dropped; 0 if the name was not cached.
+ * @note Cached paths are not checked on lookup; call this when running
+ * one fails with ENOENT or EACCES, then resolve again.
+ */
+int path_forget(const char *name);
+
+/**
+ * @brief Forget all cached lookups (PATH changed).
+ */
+void path_invalidate(void);
+
+/**
+ * @brief Print cached lookups.
+ */
+void path_print(void);
@@ -51,9 +51,13 @@ int run_dispatch(string_vector *args, run_flags *flags) {
 			return meta_result;
 		}
 
-		ast_node *parsed = parse_from_string(meta_out);
-		meta_result = eval_ast(parsed);
-		ast_recurse_free(parsed);
+		ast_node *parsed = parse_cached(meta_out);
+		if (parsed != NULL) {
+			meta_result = eval_ast(parsed);
+			parse_release(parsed);
+		} else {
+			meta_result = 1;
+		}
 
 		context_hist_add(strdup(meta_out));
 
@@ -83,5 +87,9 @@ int run_dispatch(string_vector *args, run_flags *flags) {
 	argv[args->count] = NULL;
 
 	// Exec program
+	if (flags->in_child) {
+		exec_replace(argv, flags);
+	}
+
 	return exec_normal(argv, flags);
 }
@@ -18,238 +18,255 @@
 #include <c-utils/vector.h>
 
 #include "../util/error.h"
-
-typedef union {
-	char *name;
-	uint32_t pos;
-} id;
+#include "../util/hashmap.h"
 
 typedef struct {
-	id key;
 	char *value;
-	int is_pos;
+	// Frame that owns this binding
+	uint32_t depth;
 } scoped_var;
 
-typedef vector scoped_var_vector;
-
 typedef struct {
-	scoped_var_vector vars;
-	uint32_t pos_count;
-} scope;
-
-typedef stack scope_stack;
-
-// Stack of scopes
-static scope_stack *scopes = NULL;
-// Current scope
-static scope frame;
-
-static void init_frame(void);
-static scoped_var *find_named_var(const char *key, uint32_t *index);
-static scoped_var *find_pos_var(uint32_t key, uint32_t *index);
+	// Interned by the symbol table
+	const char *name;
+	// Binding shadowed by the frame; NULL if none
+	scoped_var *prev;
+} undo_entry;
+
+typedef vector undo_vector;
+typedef stack mark_stack;
+
+// Name -> innermost binding
+static hashmap symbols;
+// Shadowed bindings of all frames, innermost last
+static undo_vector undo_log;
+// Undo log length at the start of each frame
+static mark_stack *marks = NULL;
+// Current frame depth; 0 is top-level
+static uint32_t depth = 0;
+
+// Positional arguments are shared by all frames
+// Shifted arguments stay in front of pos_start until the next grow
+static char **pos_args = NULL;
+static uint32_t pos_start = 0;
+static uint32_t pos_count = 0;
+static uint32_t pos_capacity = 0;
+
+// Cached string forms of $@ and $#; NULL when stale
+static char *pos_list = NULL;
+static char pos_count_str[16];
+static int pos_count_valid = 0;
+
+static void pos_changed(void);
+static void bind(const char *key, char *value);
+static void free_scoped_var(void *var);
 
 void scope_init(void) {
-	scopes = stack_new(sizeof(scope));
-	init_frame();
+	symbols = hashmap_init();
+	undo_log = vec_init(sizeof(undo_entry));
+	marks = stack_new(sizeof(uint32_t));
 }
 
 void scope_set_var(const char *key, const char *value) {
-	scoped_var *find_res = find_named_var(key, NULL);
-
-	if (find_res == NULL) {
-		// New variable
-		scoped_var new_var = {
-			.key.name = strdup(key),
-			.value = (value == NULL) ? strdup("") : strdup(value),
-			.is_pos = 0,
-		};
-
-		vec_push(&frame.vars, &new_var);
-	} else {
-		// Update existing
-		free(find_res->value);
-		find_res->value = strdup(value);
-	}
+	char *copy = (value == NULL) ? strdup("") : strdup(value);
+	bind(key, copy);
 }
 
 const char *scope_get_var(const char *key) {
-	scoped_var *find_res = find_named_var(key, NULL);
+	// Computed on demand
+	if (strcmp(key, "@") == 0) {
+		if (pos_list == NULL) {
+			pos_list = scope_list_pos();
+		}
+		return pos_list;
+	}
+	if (strcmp(key, "#") == 0) {
+		if (!pos_count_valid) {
+			snprintf(pos_count_str, 16, "%u", pos_count);
+			pos_count_valid = 1;
+		}
+		return pos_count_str;
+	}
+
+	scoped_var *find_res = hashmap_get(&symbols, key);
 	if (find_res == NULL) {
 		return NULL;
 	}
 
+	// NULL if unset in this frame
 	return find_res->value;
 }
 
 int scope_delete_var(const char *key) {
-	uint32_t index;
-	scoped_var *find_res = find_named_var(key, &index);
-	if (find_res == NULL) {
+	if (scope_get_var(key) == NULL) {
 		return -1;
 	}
 
-	return vec_erase(&frame.vars, index, NULL);
+	// Shadow with an unset binding so enclosing frames are restored later
+	bind(key, NULL);
+	return 0;
 }
 
 uint32_t scope_pos_count(void) {
-	return frame.pos_count;
+	return pos_count;
 }
 
 void scope_append_pos(const char *value) {
-	// 1-indexed
-	scoped_var new_pos = {
-		.key.pos = frame.pos_count + 1,
-		.value = strdup(value),
-		.is_pos = 1,
-	};
-
-	vec_push(&frame.vars, &new_pos);
-	frame.pos_count++;
-
-	// Update variables
-	char *list = scope_list_pos();
-	scope_set_var("@", list);
-	free(list);
-
-	char buffer[32];
-	snprintf(buffer, 32, "%d", frame.pos_count);
-	scope_set_var("#", buffer);
+	if (pos_start + pos_count == pos_capacity) {
+		if (pos_start * 2 >= pos_capacity && pos_start > 0) {
+			// Reuse space freed by shift, once it is half of the array
+			memmove(pos_args, pos_args + pos_start, pos_count * sizeof(char *));
+			pos_start = 0;
+		} else {
+			pos_capacity = (pos_capacity == 0) ? 16 : pos_capacity * 2;
+			pos_args = realloc(pos_args, pos_capacity * sizeof(char *));
+		}
+	}
+
+	pos_args[pos_start + pos_count++] = strdup(value);
+	pos_changed();
 }
 
 const char *scope_get_pos(uint32_t index) {
-	scoped_var *find_res = find_pos_var(index, NULL);
-	if (find_res == NULL) {
+	// 1-indexed
+	if (index == 0 || index > pos_count) {
 		return NULL;
 	}
 
-	return find_res->value;
+	return pos_args[pos_start + index - 1];
 }
 
 char *scope_list_pos(void) {
-	if (frame.pos_count == 0) {
+	if (pos_count == 0) {
 		return NULL;
 	}
 
-	uint32_t total_length = 0;
-	const char *pos_vars[frame.pos_count];
-	for (uint32_t i = 0; i < frame.pos_count; i++) {
-		// 1-indexed vars
-		scoped_var *pos_var = find_pos_var(i + 1, NULL);
-		pos_vars[i] = pos_var->value;
-		total_length += strlen(pos_var->value) + 1;
+	size_t total_length = 0;
+	for (uint32_t i = 0; i < pos_count; i++) {
+		total_length += strlen(pos_args[pos_start + i]) + 1;
 	}
 
-	char *list = calloc(total_length, sizeof(char));
+	char *list = malloc(total_length);
+	char *trav = list;
+	for (uint32_t i = 0; i < pos_count; i++) {
+		const char *value = pos_args[pos_start + i];
+		size_t length = strlen(value);
 
-	// Put first one in without a space
-	strcpy(list, pos_vars[0]);
-	for (uint32_t i = 1; i < frame.pos_count; i++) {
-		strcat(list, " ");
-		strcat(list, pos_vars[i]);
+		memcpy(trav, value, length);
+		trav += length;
+		*trav++ = ' ';
 	}
 
+	// Replace last separator
+	trav[-1] = '\0';
 	return list;
 }
 
+int scope_shift_pos(uint32_t count) {
+	if (count > pos_count) {
+		return -1;
+	}
+
+	for (uint32_t i = 0; i < count; i++) {
+		free(pos_args[pos_start + i]);
+	}
+	pos_start += count;
+	pos_count -= count;
+
+	pos_changed();
+	return 0;
+}
+
 void scope_reset_pos(void) {
-	uint32_t vec_i;
-	for (uint32_t i = 0; i < frame.pos_count; i++) {
-		find_pos_var(i, &vec_i);
-		vec_erase(&frame.vars, vec_i, NULL);
+	for (uint32_t i = 0; i < pos_count; i++) {
+		free(pos_args[pos_start + i]);
 	}
 
-	frame.pos_count = 0;
+	pos_start = 0;
+	pos_count = 0;
+	pos_changed();
 }
 
 void scope_create_frame(void) {
-	// Save scope
-	stack_push(scopes, &frame);
-
-	// Create new frame
-	init_frame();
+	// Lookups fall through until the frame binds its own variables
+	stack_push(marks, &undo_log.count);
+	depth++;
 }
 
 int scope_delete_frame(void) {
-	if (scopes->count == 0) {
-		print_error("cannot delete top-level scope");
+	uint32_t mark;
+	if (stack_pop(marks, &mark) == STACK_STATUS_EMPTY) {
+		print_error("cannot delete top-level scope\n");
 		return -1;
 	}
 
-	// Delete scope
-	for (uint32_t i = 0; i < frame.vars.count; i++) {
-		scoped_var *var = vec_at_mut(&frame.vars, i);
-		if (!var->is_pos) {
-			free(var->key.name);
-		}
+	// Restore shadowed bindings, newest first
+	while (undo_log.count > mark) {
+		undo_entry entry;
+		vec_erase(&undo_log, undo_log.count - 1, &entry);
 
-		free(var->value);
+		scoped_var *current;
+		if (entry.prev != NULL) {
+			current = hashmap_set(&symbols, entry.name, entry.prev);
+		} else {
+			current = hashmap_remove(&symbols, entry.name);
+		}
+		free_scoped_var(current);
 	}
-	vec_deinit(&frame.vars);
-
-	// Load old scope
-	stack_pop(scopes, &frame);
 
+	depth--;
 	return 0;
 }
 
 /** Internal */
 
 /**
- * @brief Initialize a new scope frame.
+ * @brief Drop cached strings after positional arguments change.
  */
-static void init_frame(void) {
-	frame.vars = vec_init(sizeof(scoped_var));
-	frame.pos_count = 0;
-
-	scope_set_var("#", "0");
+static void pos_changed(void) {
+	free(pos_list);
+	pos_list = NULL;
+	pos_count_valid = 0;
 }
 
 /**
- * @brief Find variable by name.
+ * @brief Bind variable in the current frame.
  *
  * @param[in] key - Variable name.
- * @param[out] index - If not NULL and item was found, places index here.
- * @return Scoped nonpositional variable; NULL on error.
+ * @param[in] value - Allocated value (taken over); NULL for unset.
  */
-static scoped_var *find_named_var(const char *key, uint32_t *index) {
-	for (uint32_t i = 0; i < frame.vars.count; i++) {
-		scoped_var *entry = vec_at_mut(&frame.vars, i);
-		if (entry->is_pos) {
-			continue;
-		}
-
-		if (strcmp(entry->key.name, key) == 0) {
-			if (index != NULL) {
-				*index = i;
-			}
-			return entry;
-		}
+static void bind(const char *key, char *value) {
+	scoped_var *current = hashmap_get(&symbols, key);
+
+	// Already bound in this frame
+	if (current != NULL && current->depth == depth) {
+		free(current->value);
+		current->value = value;
+		return;
 	}
 
-	return NULL;
+	scoped_var *binding = malloc(sizeof(scoped_var));
+	binding->value = value;
+	binding->depth = depth;
+	hashmap_set(&symbols, key, binding);
+
+	// Top-level bindings are never undone
+	if (depth > 0) {
+		undo_entry entry = {
+			.name = hashmap_key(&symbols, key),
+			.prev = current,
+		};
+		vec_push(&undo_log, &entry);
+	}
 }
 
 /**
- * @brief Find variable by position index.
+ * @brief Free variable binding.
  *
- * @param[in] key - Position index.
- * @param[in] index - If not NULL and item was found, places index here.
- * @return Scoped positional variable; NULL on error.
+ * @param[in] var - Binding.
  */
-static scoped_var *find_pos_var(uint32_t key, uint32_t *index) {
-	for (uint32_t i = 0; i < frame.vars.count; i++) {
-		scoped_var *entry = vec_at_mut(&frame.vars, i);
-		if (!entry->is_pos) {
-			continue;
-		}
-
-		if (entry->key.pos == key) {
-			if (index != NULL) {
-				*index = i;
-			}
-			return entry;
-		}
-	}
-
-	return NULL;
+static void free_scoped_var(void *var) {
+	scoped_var *binding = var;
+	free(binding->value);
+	free(binding);
 }
@@ -64,12 +64,21 @@ const char *scope_get_pos(uint32_t index);
 /**
  * @brief Get all positional arguments.
  *
- * @return Positional variables as a string separated by spaces.
+ * @return Positional variables as a string separated by spaces; NULL if none.
+ * @note Allocated return value.
  */
 char *scope_list_pos(void);
 
 /**
- * @brief Reset positional arguments in current scope.
+ * @brief Drop leading positional arguments.
+ *
+ * @param[in] count - Number of arguments to drop.
+ * @return 0 on success; -1 if there are not enough arguments.
+ */
+int scope_shift_pos(uint32_t count);
+
+/**
+ * @brief Remove all positional arguments.
  */
 void scope_reset_pos(void);
 
@@ -15,137 +15,210 @@
 
 #include <c-utils/vector.h>
 
+#include "../util/hashmap.h"
 #include "../util/helper.h"
+#include "path.h"
 
 typedef struct {
-	char *key;
+	// Interned - owned by the lookup table
+	const char *key;
 	char *value;
 	int is_export;
+	// Integer variables format value only when read
+	int is_int;
+	long int_value;
+	int value_valid;
+	// Exported "key=value" string and its position in the environment block
+	char *env_entry;
+	uint32_t env_index;
+	// Position in creation order
+	uint32_t order_index;
 } sh_var;
 
 typedef vector sh_var_vector;
 
-// Env var vector
-static sh_var_vector *env_vars = NULL;
+// Long enough for LONG_MIN
+#define INT_STR_MAX 24
+
+// Name -> sh_var
+static hashmap var_table;
+// Variables in creation order; deleted entries are NULL
+static sh_var_vector *var_order = NULL;
+static uint32_t order_holes = 0;
 // Export counter
 static uint32_t export_count = 0;
-
-static char *sh_var_to_string(const sh_var *var);
-static sh_var *find_sh_var(const char *key, uint32_t *index);
+// Null-terminated environment block for children
+static char **env_block = NULL;
+static uint32_t env_capacity = 0;
+
+static char *sh_var_to_string(sh_var *var);
+static sh_var *find_sh_var(const char *key);
+static const char *var_value(sh_var *var);
+static sh_var *new_sh_var(const char *key, const char *value);
+static void free_sh_var(void *var);
+static void compact_order(void);
+static void env_add(sh_var *var);
+static void env_update(sh_var *var);
+static void env_remove(sh_var *var);
 
 void vars_import(char *const *env) {
 	// Reset env vars if populated
-	if (env_vars != NULL) {
-		vec_delete(env_vars);
+	if (var_order != NULL) {
+		hashmap_deinit(&var_table, &free_sh_var);
+		vec_delete(var_order);
+		order_holes = 0;
 		export_count = 0;
+		if (env_block != NULL) {
+			env_block[0] = NULL;
+		}
 	}
 
-	env_vars = vec_new(sizeof(sh_var));
+	var_table = hashmap_init();
+	var_order = vec_new(sizeof(sh_var *));
 	while (*env != NULL) {
-		char *copy = strdup(*env);
-
-		char *key = strtok(copy, "=");
-		char *value = strtok(NULL, "=");
-
-		// Value may be NULL
-		sh_var var = {
-			.key = strdup(key),
-			.value = (value == NULL) ? strdup("") : strdup(value),
-			.is_export = 1,
-		};
-
-		free(copy);
-		vec_push(env_vars, &var);
+		// Value may contain '=' too
+		const char *equals = strchr(*env, '=');
+		char *key = (equals != NULL) ? strndup(*env, equals - *env)
+									 : strdup(*env);
+		const char *value = (equals != NULL) ? equals + 1 : NULL;
+
+		// Later duplicates replace the value (and keep one env entry)
+		if (find_sh_var(key) != NULL) {
+			vars_set(key, value);
+		} else {
+			// Value may be NULL
+			sh_var *var = new_sh_var(key, value);
+			var->is_export = 1;
+			env_add(var);
+		}
 
+		free(key);
 		env++;
-		export_count++;
 	}
 }
 
-char **vars_export(void) {
-	if (env_vars == NULL) {
+char *const *vars_export(void) {
+	if (var_order == NULL) {
 		return NULL;
 	}
 
-	char **env = ntmalloc(export_count, sizeof(char **));
-	uint32_t index = 0;
-
-	for (uint32_t i = 0; i < env_vars->count; i++) {
-		const sh_var *entry = vec_at(env_vars, i);
-		if (entry == NULL) {
-			return NULL;
-		}
-
-		if (entry->is_export) {
-			env[index] = sh_var_to_string(entry);
-			index++;
-		}
+	// Empty environment still needs a terminator
+	if (env_block == NULL) {
+		env_capacity = 1;
+		env_block = calloc(env_capacity, sizeof(char *));
 	}
 
-	return env;
+	return env_block;
 }
 
 void vars_set(const char *key, const char *value) {
-	sh_var *find_res = find_sh_var(key, NULL);
+	if (strcmp(key, "PATH") == 0) {
+		path_invalidate();
+	}
+
+	sh_var *find_res = find_sh_var(key);
 
 	if (find_res == NULL) {
 		// Create new variable
-		sh_var new_var = {
-			.key = strdup(key),
-			.value = (value == NULL) ? strdup("") : strdup(value),
-			.is_export = 0,
-		};
-		vec_push(env_vars, &new_var);
+		new_sh_var(key, value);
 	} else {
 		// Update existing
 		free(find_res->value);
-		find_res->value = strdup(value);
+		find_res->value = (value == NULL) ? strdup("") : strdup(value);
+		find_res->is_int = 0;
+		find_res->value_valid = 1;
+
+		if (find_res->is_export) {
+			env_update(find_res);
+		}
+	}
+}
+
+void vars_set_int(const char *key, long value) {
+	sh_var *find_res = find_sh_var(key);
+	if (find_res == NULL) {
+		find_res = new_sh_var(key, NULL);
+	}
+
+	if (!find_res->is_int) {
+		// Buffer is reused by every later update
+		free(find_res->value);
+		find_res->value = malloc(INT_STR_MAX);
+		find_res->is_int = 1;
+	} else if (find_res->int_value == value) {
+		return;
+	}
+
+	find_res->int_value = value;
+	find_res->value_valid = 0;
+
+	if (find_res->is_export) {
+		env_update(find_res);
 	}
 }
 
 const char *vars_get(const char *key) {
-	sh_var *find_res = find_sh_var(key, NULL);
+	sh_var *find_res = find_sh_var(key);
 	if (find_res == NULL) {
 		return NULL;
 	}
 
-	return find_res->value;
+	return var_value(find_res);
 }
 
 int vars_delete(const char *key) {
-	uint32_t index;
-	sh_var *find_res = find_sh_var(key, &index);
+	sh_var *find_res = find_sh_var(key);
 	if (find_res == NULL) {
 		return -1;
 	}
 
-	return vec_erase(env_vars, index, NULL);
+	if (strcmp(key, "PATH") == 0) {
+		path_invalidate();
+	}
+
+	if (find_res->is_export) {
+		env_remove(find_res);
+	}
+
+	// Leave a hole to keep the order; compact once half is holes
+	sh_var **slot = vec_at_mut(var_order, find_res->order_index);
+	*slot = NULL;
+	order_holes++;
+	if (order_holes * 2 > var_order->count) {
+		compact_order();
+	}
+
+	hashmap_remove(&var_table, key);
+	free_sh_var(find_res);
+
+	return 0;
 }
 
 int vars_set_export(const char *key) {
-	sh_var *find_res = find_sh_var(key, NULL);
+	sh_var *find_res = find_sh_var(key);
 	if (find_res == NULL) {
 		return -1;
 	}
 
 	if (!find_res->is_export) {
 		find_res->is_export = 1;
-		export_count++;
+		env_add(find_res);
 	}
 
 	return 0;
 }
 
 void vars_print_all(int export_flag) {
-	if (env_vars == NULL) {
+	if (var_order == NULL) {
 		return;
 	}
 
-	for (uint32_t i = 0; i < env_vars->count; i++) {
-		const sh_var *entry = vec_at(env_vars, i);
+	for (uint32_t i = 0; i < var_order->count; i++) {
+		sh_var *const *slot = vec_at(var_order, i);
+		sh_var *entry = *slot;
 
-		// If export is set, skip unexported
-		if (export_flag && !entry->is_export) {
+		// Skip deleted and, if export is set, unexported
+		if (entry == NULL || (export_flag && !entry->is_export)) {
 			continue;
 		}
 
@@ -154,7 +227,7 @@ void vars_print_all(int export_flag) {
 			printf("export ");
 		}
 
-		printf("%s=%s\n", entry->key, entry->value);
+		printf("%s=%s\n", entry->key, var_value(entry));
 	}
 }
 
@@ -167,11 +240,12 @@ void vars_print_all(int export_flag) {
  * @return String representation; NULL on error.
  * @note Allocated return value.
  */
-static char *sh_var_to_string(const sh_var *var) {
-	size_t str_len = strlen(var->key) + strlen(var->value) + 1;
+static char *sh_var_to_string(sh_var *var) {
+	const char *value = var_value(var);
+	size_t str_len = strlen(var->key) + strlen(value) + 1;
 	char *str = ntmalloc(str_len, sizeof(char));
 
-	if (snprintf(str, str_len + 1, "%s=%s", var->key, var->value) < 0) {
+	if (snprintf(str, str_len + 1, "%s=%s", var->key, value) < 0) {
 		return NULL;
 	}
 
@@ -182,19 +256,143 @@ static char *sh_var_to_string(const sh_var *var) {
  * @brief Find shell variable entry by name.
  *
  * @param[in] key - Variable name.
- * @param[out] index - If not NULL and item was found, places index here.
  * @return Shell variable structure; NULL on error.
  */
-static sh_var *find_sh_var(const char *key, uint32_t *index) {
-	for (uint32_t i = 0; i < env_vars->count; i++) {
-		sh_var *entry = vec_at_mut(env_vars, i);
-		if (strcmp(entry->key, key) == 0) {
-			if (index != NULL) {
-				*index = i;
-			}
-			return entry;
+static sh_var *find_sh_var(const char *key) {
+	return hashmap_get(&var_table, key);
+}
+
+/**
+ * @brief Get variable value, formatting integers if needed.
+ *
+ * @param[in,out] var - Internal variable struct.
+ * @return Variable value.
+ */
+static const char *var_value(sh_var *var) {
+	if (!var->value_valid) {
+		snprintf(var->value, INT_STR_MAX, "%ld", var->int_value);
+		var->value_valid = 1;
+	}
+
+	return var->value;
+}
+
+/**
+ * @brief Create a shell variable and add it to the table.
+ *
+ * @param[in] key - Variable name (must not exist).
+ * @param[in] value - Variable value; NULL for empty.
+ * @return Shell variable structure.
+ */
+static sh_var *new_sh_var(const char *key, const char *value) {
+	if (var_order == NULL) {
+		var_order = vec_new(sizeof(sh_var *));
+	}
+
+	sh_var *var = malloc(sizeof(sh_var));
+	var->value = (value == NULL) ? strdup("") : strdup(value);
+	var->is_export = 0;
+	var->is_int = 0;
+	var->int_value = 0;
+	var->value_valid = 1;
+	var->env_entry = NULL;
+	var->order_index = var_order->count;
+
+	hashmap_set(&var_table, key, var);
+	var->key = hashmap_key(&var_table, key);
+	vec_push(var_order, &var);
+
+	return var;
+}
+
+/**
+ * @brief Free shell variable structure (key is owned by the table).
+ *
+ * @param[in] var - Shell variable structure.
+ */
+static void free_sh_var(void *var) {
+	sh_var *entry = var;
+	free(entry->value);
+	free(entry->env_entry);
+	free(entry);
+}
+
+/**
+ * @brief Drop holes left by deleted variables from the order list.
+ */
+static void compact_order(void) {
+	sh_var_vector *compacted = vec_new(sizeof(sh_var *));
+	for (uint32_t i = 0; i < var_order->count; i++) {
+		sh_var *const *slot = vec_at(var_order, i);
+		if (*slot == NULL) {
+			continue;
 		}
+
+		(*slot)->order_index = compacted->count;
+		vec_push(compacted, slot);
 	}
 
-	return NULL;
+	vec_delete(var_order);
+	var_order = compacted;
+	order_holes = 0;
+}
+
+/**
+ * @brief Append exported variable to the environment block.
+ *
+ * @param[in,out] var - Internal variable struct.
+ */
+static void env_add(sh_var *var) {
+	// Keep room for the null-terminator
+	if (export_count + 2 > env_capacity) {
+		env_capacity = (env_capacity == 0) ? 16 : env_capacity * 2;
+		env_block = realloc(env_block, env_capacity * sizeof(char *));
+	}
+
+	var->env_entry = sh_var_to_string(var);
+	var->env_index = export_count;
+
+	env_block[export_count++] = var->env_entry;
+	env_block[export_count] = NULL;
+}
+
+/**
+ * @brief Replace exported variable's entry in the environment block.
+ *
+ * @param[in,out] var - Internal variable struct.
+ */
+static void env_update(sh_var *var) {
+	free(var->env_entry);
+
+	var->env_entry = sh_var_to_string(var);
+	env_block[var->env_index] = var->env_entry;
+}
+
+/**
+ * @brief Remove exported variable from the environment block.
+ *
+ * @param[in,out] var - Internal variable struct.
+ */
+static void env_remove(sh_var *var) {
+	uint32_t last = export_count - 1;
+
+	// Move the last entry into the gap
+	if (var->env_index != last) {
+		char *moved = env_block[last];
+		size_t key_len = strchr(moved, '=') - moved;
+
+		char moved_key[key_len + 1];
+		memcpy(moved_key, moved, key_len);
+		moved_key[key_len] = '\0';
+
+		sh_var *moved_var = find_sh_var(moved_key);
+		moved_var->env_index = var->env_index;
+		env_block[var->env_index] = moved;
+	}
+
+	export_count--;
+	env_block[export_count] = NULL;
+
+	free(var->env_entry);
+	var->env_entry = NULL;
 }
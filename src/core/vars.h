@@ -19,9 +19,9 @@ void vars_import(char *const *env);
  * @brief Export environment variables.
  *
  * @return Null-terminated list of environment vars; NULL on error.
- * @note Allocated return value.
+ * @note Owned by the shell; valid until the next variable change.
  */
-char **vars_export(void);
+char *const *vars_export(void);
 
 /**
  * @brief Create or edit an environment variable.
@@ -31,6 +31,15 @@ char **vars_export(void);
  */
 void vars_set(const char *key, const char *value);
 
+/**
+ * @brief Create or edit an integer variable.
+ *
+ * @param[in] key - Variable name.
+ * @param[in] value - New variable value.
+ * @note Formatted as a string only when read.
+ */
+void vars_set_int(const char *key, long value);
+
 /**
  * @brief Get value of an environment variable.
  *
@@ -9,87 +9,156 @@
 #define _POSIX_C_SOURCE 200809L
 #include "ast.h"
 
-#include <stdlib.h>
 #include <string.h>
 
-static ast_node *ast_make_node(
-	ast_kind kind, ast_value value, ast_node *left, ast_node *right);
+#include "../util/arena.h"
+
+static ast_node *ast_make_node(ast_builder *builder, ast_kind kind,
+	ast_value value, ast_node *left, ast_node *right);
 
 static ast_node *ast_make_noval_node(
-	ast_kind kind, ast_node *left, ast_node *right);
+	ast_builder *builder, ast_kind kind, ast_node *left, ast_node *right);
+
+static ast_node **collect_parts(ast_builder *builder, vector *parts);
+static int contains_any(const char *text, size_t length, const char *chars);
+
+ast_builder ast_builder_init(arena *mem) {
+	ast_builder builder = {
+		.mem = mem,
+		.open_views = NULL,
+		.words = vec_init(sizeof(ast_node *)),
+		.redirs = vec_init(sizeof(ast_node *)),
+		.assigns = vec_init(sizeof(ast_node *)),
+	};
 
-ast_node *ast_make_seq(ast_seq_value value, ast_node *left, ast_node *right) {
+	return builder;
+}
+
+void ast_builder_deinit(ast_builder *builder) {
+	vec_deinit(&builder->words);
+	vec_deinit(&builder->redirs);
+	vec_deinit(&builder->assigns);
+}
+
+ast_node *ast_make_seq(ast_builder *builder, ast_seq_value value,
+	ast_node *left, ast_node *right) {
 	ast_value astv = { .seq = value };
-	return ast_make_node(AST_KIND_SEQ, astv, left, right);
+	return ast_make_node(builder, AST_KIND_SEQ, astv, left, right);
 }
 
-ast_node *ast_make_cond(ast_cond_value value, ast_node *left, ast_node *right) {
+ast_node *ast_make_cond(ast_builder *builder, ast_cond_value value,
+	ast_node *left, ast_node *right) {
 	ast_value astv = { .cond = value };
-	return ast_make_node(AST_KIND_COND, astv, left, right);
+	return ast_make_node(builder, AST_KIND_COND, astv, left, right);
 }
 
-ast_node *ast_make_rdr(ast_rdr_value value, ast_node *left, ast_node *right) {
+ast_node *ast_make_rdr(ast_builder *builder, ast_rdr_value value,
+	ast_node *left, ast_node *right) {
 	ast_value astv = { .rdr = value };
-	return ast_make_node(AST_KIND_RDR, astv, left, right);
+	return ast_make_node(builder, AST_KIND_RDR, astv, left, right);
 }
 
-ast_node *ast_make_run(ast_run_value value, ast_node *left, ast_node *right) {
-	ast_value astv = { .run = value };
-	return ast_make_node(AST_KIND_RUN, astv, left, right);
+void ast_command_push(ast_builder *builder, ast_node *part) {
+	switch (part->kind) {
+	case AST_KIND_WORD:
+		vec_push(&builder->words, &part);
+		break;
+	case AST_KIND_RDR:
+		vec_push(&builder->redirs, &part);
+		break;
+	case AST_KIND_ASSIGN:
+		vec_push(&builder->assigns, &part);
+		break;
+	default:
+		break;
+	}
 }
 
-ast_node *ast_make_fdnum(int value) {
-	ast_value astv = { .fdnum = value };
-	return ast_make_node(AST_KIND_FDNUM, astv, NULL, NULL);
-}
+ast_node *ast_make_command(ast_builder *builder) {
+	ast_command *cmd = arena_alloc(builder->mem, sizeof(ast_command));
+
+	cmd->word_count = builder->words.count;
+	cmd->redir_count = builder->redirs.count;
+	cmd->assign_count = builder->assigns.count;
+	cmd->words = collect_parts(builder, &builder->words);
+	cmd->redirs = collect_parts(builder, &builder->redirs);
+	cmd->assigns = collect_parts(builder, &builder->assigns);
 
-ast_node *ast_make_pipe(ast_node *left, ast_node *right) {
-	return ast_make_noval_node(AST_KIND_PIPE, left, right);
+	ast_value astv = { .cmd = cmd };
+	return ast_make_node(builder, AST_KIND_RUN, astv, NULL, NULL);
 }
 
-ast_node *ast_make_join(ast_node *left, ast_node *right) {
-	return ast_make_noval_node(AST_KIND_JOIN, left, right);
+ast_node *ast_make_fdnum(ast_builder *builder, int value) {
+	ast_value astv = { .fdnum = value };
+	return ast_make_node(builder, AST_KIND_FDNUM, astv, NULL, NULL);
 }
 
-ast_node *ast_strdup(ast_kind kind, const char *value) {
-	ast_value val = { .str = strdup(value) };
-	return ast_make_node(kind, val, NULL, NULL);
+ast_node *ast_make_pipe(
+	ast_builder *builder, ast_node *left, ast_node *right) {
+	return ast_make_noval_node(builder, AST_KIND_PIPE, left, right);
 }
 
-void ast_recurse_free(ast_node *node) {
-	if (node == NULL) {
-		return;
+ast_node *ast_make_str(
+	ast_builder *builder, ast_kind kind, char *text, size_t length) {
+	// Tokens can be adjacent (quoted run followed by a word), in which case
+	// the terminator of the previous one would land on this one
+	ast_node *prev = builder->open_views;
+	if (prev != NULL && prev->value.str + prev->length == text) {
+		char *copy = arena_alloc(builder->mem, prev->length + 1);
+		memcpy(copy, prev->value.str, prev->length);
+		copy[prev->length] = '\0';
+
+		prev->value.str = copy;
+		builder->open_views = prev->left;
+		prev->left = NULL;
 	}
 
-	ast_recurse_free(node->left);
-	ast_recurse_free(node->right);
+	ast_value val = { .str = text };
+	ast_node *node =
+		ast_make_node(builder, kind, val, builder->open_views, NULL);
+	node->length = length;
+	builder->open_views = node;
 
-	switch (node->kind) {
-	case AST_KIND_WORD: // fallthrough
-	case AST_KIND_ASSIGN:
-		free(node->value.str);
-		break;
-	default:
-		break;
+	// Lets expansion skip words that are already final
+	if (contains_any(text, length, "\\'\"")) {
+		node->flags |= AST_WORD_QUOTED;
 	}
+	if (contains_any(text, length, "$~")) {
+		node->flags |= AST_WORD_EXPAND;
+	}
+
+	return node;
+}
+
+void ast_end_views(ast_builder *builder) {
+	// Character after a token is a separator or operator, already lexed
+	while (builder->open_views != NULL) {
+		ast_node *node = builder->open_views;
+		builder->open_views = node->left;
 
-	free(node);
+		// Open views still point into the writable parse buffer
+		((char *)node->value.str)[node->length] = '\0';
+		node->left = NULL;
+	}
 }
 
 /**
  * @brief Create a new AST node with a value.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] kind - Node kind.
  * @param[in] value - Node value.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
-static ast_node *ast_make_node(
-	ast_kind kind, ast_value value, ast_node *left, ast_node *right) {
-	ast_node *node = malloc(sizeof(ast_node));
+static ast_node *ast_make_node(ast_builder *builder, ast_kind kind,
+	ast_value value, ast_node *left, ast_node *right) {
+	ast_node *node = arena_alloc(builder->mem, sizeof(ast_node));
 
 	node->kind = kind;
+	node->flags = 0;
+	node->length = 0;
 	node->left = left;
 	node->right = right;
 	node->value = value;
@@ -100,16 +169,19 @@ static ast_node *ast_make_node(
 /**
  * @brief Create a new AST node without a value.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] kind - Node kind.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
 static ast_node *ast_make_noval_node(
-	ast_kind kind, ast_node *left, ast_node *right) {
-	ast_node *node = malloc(sizeof(ast_node));
+	ast_builder *builder, ast_kind kind, ast_node *left, ast_node *right) {
+	ast_node *node = arena_alloc(builder->mem, sizeof(ast_node));
 
 	node->kind = kind;
+	node->flags = 0;
+	node->length = 0;
 	node->left = left;
 	node->right = right;
 
@@ -118,3 +190,42 @@ static ast_node *ast_make_noval_node(
 
 	return node;
 }
+
+/**
+ * @brief Move pushed command parts into an array in the arena.
+ *
+ * @param[in,out] builder - Builder state.
+ * @param[in,out] parts - Pushed parts; emptied.
+ * @return Array of parts; NULL if there are none.
+ */
+static ast_node **collect_parts(ast_builder *builder, vector *parts) {
+	if (parts->count == 0) {
+		return NULL;
+	}
+
+	size_t size = parts->count * sizeof(ast_node *);
+	ast_node **array = arena_alloc(builder->mem, size);
+	memcpy(array, vec_at(parts, 0), size);
+
+	// Storage is kept for the next command
+	parts->count = 0;
+	return array;
+}
+
+/**
+ * @brief Check if a token contains any of the given characters.
+ *
+ * @param[in] text - Token start.
+ * @param[in] length - Token length.
+ * @param[in] chars - Characters to look for.
+ * @return 1 if found; 0 otherwise.
+ */
+static int contains_any(const char *text, size_t length, const char *chars) {
+	for (size_t i = 0; i < length; i++) {
+		if (strchr(chars, text[i]) != NULL) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
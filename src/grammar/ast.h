@@ -8,13 +8,19 @@
  */
 #pragma once
 
+#include <stdint.h>
+
 #include <c-utils/vector.h>
 
+// Forward declared, since this header is also built with generated sources
+struct arena;
+
 typedef enum {
 	// Enum value
 	AST_KIND_SEQ,
 	AST_KIND_COND,
 	AST_KIND_RDR,
+	// Command value
 	AST_KIND_RUN,
 	// Literal value
 	AST_KIND_WORD,
@@ -22,7 +28,6 @@ typedef enum {
 	AST_KIND_ASSIGN,
 	// No value
 	AST_KIND_PIPE,
-	AST_KIND_JOIN,
 } ast_kind;
 
 typedef enum {
@@ -45,24 +50,41 @@ typedef enum {
 	AST_RDR_I_IO,
 } ast_rdr_value;
 
-typedef enum {
-	AST_RUN_APPLY,
-	AST_RUN_EXECUTE,
-	AST_RUN_SHELL_ENV,
-} ast_run_value;
+struct ast_node;
+
+typedef struct {
+	// Command name and arguments; none for assignment-only commands
+	struct ast_node **words;
+	// Redirections, in order of appearance
+	struct ast_node **redirs;
+	// Variable assignments, in order of appearance
+	struct ast_node **assigns;
+
+	uint32_t word_count;
+	uint32_t redir_count;
+	uint32_t assign_count;
+} ast_command;
 
 typedef union {
 	ast_seq_value seq;
 	ast_cond_value cond;
 	ast_rdr_value rdr;
-	ast_run_value run;
+	ast_command *cmd;
 
-	char *str;
+	const char *str;
 	int fdnum;
 } ast_value;
 
+// Word flags, set when the token is created
+#define AST_WORD_QUOTED 0x1
+#define AST_WORD_EXPAND 0x2
+
 typedef struct ast_node {
 	ast_kind kind;
+	// AST_WORD_* for string-type nodes; 0 otherwise
+	unsigned int flags;
+	// String length for string-type nodes
+	size_t length;
 
 	struct ast_node *left;
 	struct ast_node *right;
@@ -70,84 +92,122 @@ typedef struct ast_node {
 	ast_value value;
 } ast_node;
 
+typedef struct {
+	// Owns nodes and strings
+	struct arena *mem;
+	// String nodes waiting to be terminated, chained through 'left'
+	ast_node *open_views;
+
+	// Parts of the command being parsed
+	vector words;
+	vector redirs;
+	vector assigns;
+} ast_builder;
+
+/**
+ * @brief Create builder state for one parse.
+ *
+ * @param[in] mem - Arena that will own the tree.
+ * @return Builder object.
+ */
+ast_builder ast_builder_init(struct arena *mem);
+
+/**
+ * @brief Free builder state (the tree is owned by the arena).
+ *
+ * @param[in,out] builder - Builder state.
+ */
+void ast_builder_deinit(ast_builder *builder);
+
 /**
  * @brief Create a sequence AST node.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] value - Sequence type.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
-ast_node *ast_make_seq(ast_seq_value value, ast_node *left, ast_node *right);
+ast_node *ast_make_seq(ast_builder *builder, ast_seq_value value,
+	ast_node *left, ast_node *right);
 
 /**
  * @brief Create a conditional list AST node.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] value - Condition type.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
-ast_node *ast_make_cond(ast_cond_value value, ast_node *left, ast_node *right);
+ast_node *ast_make_cond(ast_builder *builder, ast_cond_value value,
+	ast_node *left, ast_node *right);
 
 /**
  * @brief Create a redirection AST node.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] value - Redirection type.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
-ast_node *ast_make_rdr(ast_rdr_value value, ast_node *left, ast_node *right);
+ast_node *ast_make_rdr(ast_builder *builder, ast_rdr_value value,
+	ast_node *left, ast_node *right);
 
 /**
- * @brief Create a run AST node.
+ * @brief Add a word, redirection or assignment to the current command.
  *
- * @param[in] value - Runnable kind.
- * @param[in] left - Left node.
- * @param[in] right - Right node.
- * @return New AST node.
+ * @param[in,out] builder - Builder state.
+ * @param[in] part - Word, redirection or assignment node.
  */
-ast_node *ast_make_run(ast_run_value value, ast_node *left, ast_node *right);
+void ast_command_push(ast_builder *builder, ast_node *part);
 
 /**
- * @brief Create a file descriptor AST node.
+ * @brief Create a run AST node from the parts pushed since the last one.
  *
- * @param[in] value - File descriptor.
+ * @param[in,out] builder - Builder state.
  * @return New AST node.
  */
-ast_node *ast_make_fdnum(int value);
+ast_node *ast_make_command(ast_builder *builder);
 
 /**
- * @brief Create a pipe AST node.
+ * @brief Create a file descriptor AST node.
  *
- * @param[in] left - Left node.
- * @param[in] right - Right node.
+ * @param[in,out] builder - Builder state.
+ * @param[in] value - File descriptor.
  * @return New AST node.
  */
-ast_node *ast_make_pipe(ast_node *left, ast_node *right);
+ast_node *ast_make_fdnum(ast_builder *builder, int value);
 
 /**
- * @brief Create a join AST node.
+ * @brief Create a pipe AST node.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] left - Left node.
  * @param[in] right - Right node.
  * @return New AST node.
  */
-ast_node *ast_make_join(ast_node *left, ast_node *right);
+ast_node *ast_make_pipe(
+	ast_builder *builder, ast_node *left, ast_node *right);
 
 /**
- * @brief Duplicate a string into a string-type node.
+ * @brief Create a string-type node referencing the input buffer.
  *
+ * @param[in,out] builder - Builder state.
  * @param[in] kind - String-type node kind.
- * @param[in] value - String value.
+ * @param[in] text - Start of the token in the input buffer.
+ * @param[in] length - Token length.
  * @return New AST node.
+ * @note String is not null-terminated until ast_end_views is called.
  */
-ast_node *ast_strdup(ast_kind kind, const char *value);
+ast_node *ast_make_str(
+	ast_builder *builder, ast_kind kind, char *text, size_t length);
 
 /**
- * @brief Recursively free the AST.
+ * @brief Null-terminate strings of all nodes created since the last call.
  *
- * @param[in] node - Root node.
+ * @param[in,out] builder - Builder state.
+ * @note Call once the lexer is done with the input buffer.
  */
-void ast_recurse_free(ast_node *node);
+void ast_end_views(ast_builder *builder);
@@ -7,175 +7,375 @@
  * @brief Word expansions.
  */
 #define _POSIX_C_SOURCE 200809L
+// syscall is not part of POSIX
+#define _DEFAULT_SOURCE
 #include "expand.h"
 
 #include <ctype.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #include <c-utils/vector-ext.h>
 #include <c-utils/vector.h>
 
+#include "../core/child.h"
+#include "../core/eval.h"
 #include "../core/exec.h"
+#include "../core/flags.h"
 #include "../core/scope.h"
 #include "../core/vars.h"
 #include "../ext/context.h"
 #include "../util/error.h"
+#include "../util/scan.h"
+#include "ast.h"
+#include "parse.h"
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#ifdef SYS_memfd_create
+#define HAVE_MEMFD
+#ifndef MFD_CLOEXEC
+#define MFD_CLOEXEC 1U
+#endif
+#endif
+#endif
+
+// Track quote state
+typedef enum {
+	Q_NONE,
+	Q_SINGLE,
+	Q_DOUBLE,
+} quote_st;
 
 #define RD_BUF_LEN 1024
-
+// Limit for captured command output
+#define CAPTURE_MAX_LEN (256 * 1024 * 1024)
+
+// Fields being produced by an expansion
+typedef struct {
+	// NULL if the result is a single string
+	string_vector *fields;
+	char_vector current;
+	// Current field exists, even if empty ("")
+	int has_field;
+} field_builder;
+
+// Characters that end a literal run, by quoting state
+static const char *const specials[] = {
+	[Q_NONE] = "\\'\"$",
+	[Q_SINGLE] = "'",
+	[Q_DOUBLE] = "\\\"$",
+};
+
+// Default field separators
+#define IFS_CHARS " \t\n"
+
+static void expand(const char *word, field_builder *builder);
+static const char *expand_dollar(
+	const char *start, field_builder *builder, int quoted);
+static void push_literal(field_builder *builder, const char *str, size_t len);
+static void push_value(field_builder *builder, const char *value, int quoted);
+static void end_field(field_builder *builder);
 static char *parse_command(const char *start, const char **end);
 static char *parse_variable(const char *start, const char **end);
 static char *subshell_eval(const char *command);
+static char *capture_subshell(ast_node *root);
+static char *capture_in_process(ast_node *root);
+static int open_memfd(void);
+static char *read_all(int fd, size_t size_hint);
 
 char *expand_word(const char *word) {
-	char_vector expanded = vec_init(sizeof(char));
+	if (word == NULL) {
+		return strdup("");
+	}
 
-	int noexpand = 0;
-	uint32_t pending = 0;
+	// Single field, no splitting
+	field_builder builder = {
+		.fields = NULL,
+		.current = vec_init(sizeof(char)),
+		.has_field = 1,
+	};
+	expand(word, &builder);
 
-	const char *trav = word;
-	char ch;
-	while ((ch = *trav++) != '\0') {
-		switch (ch) {
-		case '\\':
-			// Don't touch escaped characters yet
-			pending += 2;
-			break;
-		case '\'':
-			noexpand = !noexpand;
-			pending++;
-			break;
-		case '~': {
-			if (noexpand) {
-				pending++;
-				break;
-			}
+	vec_push(&builder.current, &null_char);
+	return vec_collect(&builder.current);
+}
 
-			// Flush pending
-			vec_bulk_push(&expanded, word, pending);
-			word += pending + 1;
-			trav = word;
-			pending = 0;
+void expand_fields(
+	const ast_node *word, string_vector *fields, string_vector *owned) {
+	const char *str = word->value.str;
 
-			const char *home = vars_get("HOME");
-			if (home != NULL) {
-				vec_bulk_push(&expanded, home, strlen(home));
-			}
+	// Nothing to expand or remove - the token is the field
+	if ((word->flags & (AST_WORD_QUOTED | AST_WORD_EXPAND)) == 0) {
+		// Can be a read-only mapping; argv is never written to
+		char *field = (char *)str;
+		vec_push(fields, &field);
+		return;
+	}
+
+	uint32_t first = fields->count;
+	field_builder builder = {
+		.fields = fields,
+		.current = vec_init(sizeof(char)),
+		.has_field = 0,
+	};
+	expand(str, &builder);
+
+	end_field(&builder);
+	vec_deinit(&builder.current);
 
+	for (uint32_t i = first; i < fields->count; i++) {
+		vec_push(owned, vec_at(fields, i));
+	}
+}
+
+int preprocess_buffer(const char *input, char **output) {
+	char_vector expanded = vec_init(sizeof(char));
+
+	int noexpand = 0;
+	const char *trav = input;
+	while (*trav != '\0') {
+		// Copy up to the next quote or context reference in bulk
+		size_t run = scan_span(trav, "':");
+		vec_bulk_push(&expanded, trav, run);
+		trav += run;
+
+		char ch = *trav;
+		if (ch == '\0') {
 			break;
 		}
-		case '$':
-			if (noexpand) {
-				pending++;
-				break;
-			}
+		trav++;
 
-			// Flush pending
-			vec_bulk_push(&expanded, word, pending);
-			word += pending;
-			pending = 0;
-
-			ch = *trav;
-			if (ch == '(') {
-				char *command = parse_command(++trav, &word);
-				char *result = subshell_eval(command);
-				vec_bulk_push(&expanded, result, strlen(result));
-				free(command);
-				free(result);
-			} else if (isdigit(ch)) {
-				uint32_t position = strtoul(trav, (char **)&word, 10);
-				const char *value = scope_get_pos(position);
-				if (value != NULL) {
-					vec_bulk_push(&expanded, value, strlen(value));
-				}
-			} else {
-				char *var_name = parse_variable(trav, &word);
-
-				// Try scope first
-				const char *value = scope_get_var(var_name);
-				if (value == NULL) {
-					// Then check the environment
-					value = vars_get(var_name);
-				}
-
-				if (value != NULL) {
-					vec_bulk_push(&expanded, value, strlen(value));
-				}
-				free(var_name);
-			}
-			trav = word;
-			break;
-		default:
-			pending++;
-			break;
+		if (ch == '\'') {
+			noexpand = !noexpand;
+			vec_push(&expanded, &ch);
+			continue;
+		}
+
+		// Context reference ':N'
+		if (noexpand || (!isdigit(*trav) && *trav != '-')) {
+			vec_push(&expanded, &ch);
+			continue;
+		}
+
+		// Parse index
+		const char *end;
+		int32_t index = strtol(trav, (char **)&end, 10);
+
+		const char *value = context_get_row(index);
+		if (value == NULL) {
+			print_warning("no row '%d' in current context\n", index);
+			vec_deinit(&expanded);
+			return -1;
 		}
-	}
 
-	if (pending > 0) {
-		vec_bulk_push(&expanded, word, pending);
+		vec_bulk_push(&expanded, value, strlen(value));
+		trav = end;
 	}
 
 	// Null-terminate string
 	vec_push(&expanded, &null_char);
-	return vec_collect(&expanded);
+	*output = vec_collect(&expanded);
+	return 0;
 }
 
-int preprocess_buffer(const char *input, char **output) {
-	char_vector expanded = vec_init(sizeof(char));
-
+int preprocess_needed(const char *input) {
 	int noexpand = 0;
-	uint32_t pending = 0;
-
 	const char *trav = input;
-	char ch;
-	while ((ch = *trav++) != '\0') {
-		switch (ch) {
-		case '\'':
+	while (1) {
+		trav += scan_span(trav, "':");
+
+		char ch = *trav;
+		if (ch == '\0') {
+			return 0;
+		}
+		trav++;
+
+		if (ch == '\'') {
 			noexpand = !noexpand;
-			pending++;
-			break;
-		case ':':
-			if (noexpand || (!isdigit(*trav) && *trav != '-')) {
-				pending++;
+		} else if (!noexpand && (isdigit(*trav) || *trav == '-')) {
+			return 1;
+		}
+	}
+}
+
+/**
+ * @brief Expand a word in one pass, removing quotes.
+ *
+ * @param[in] word - Input string.
+ * @param[in,out] builder - Receives the fields.
+ */
+static void expand(const char *word, field_builder *builder) {
+	quote_st quotes = Q_NONE;
+	const char *trav = word;
+
+	// Tilde prefix
+	if (*trav == '~') {
+		const char *home = vars_get("HOME");
+		if (home != NULL) {
+			push_literal(builder, home, strlen(home));
+		}
+		trav++;
+	}
+
+	while (*trav != '\0') {
+		// Copy plain run in bulk
+		size_t run = scan_span(trav, specials[quotes]);
+		if (run > 0) {
+			push_literal(builder, trav, run);
+			trav += run;
+			continue;
+		}
+
+		char ch = *trav++;
+		switch (ch) {
+		case '\\':
+			if (*trav == '\0') {
+				push_literal(builder, &ch, 1);
 				break;
 			}
 
-			// Flush pending
-			vec_bulk_push(&expanded, input, pending);
-			input += pending;
-			pending = 0;
-
-			// Parse index
-			int32_t index = strtol(trav, (char **)&input, 10);
-
-			const char *value = context_get_row(index);
-			if (value == NULL) {
-				print_warning("no row '%d' in current context\n", index);
-				vec_deinit(&expanded);
-				return -1;
-			} else {
-				vec_bulk_push(&expanded, value, strlen(value));
-				trav = input;
+			// In double quotes only some characters are escapable
+			if (quotes == Q_DOUBLE && strchr("\\\"$`", *trav) == NULL) {
+				push_literal(builder, &ch, 1);
 			}
+			push_literal(builder, trav++, 1);
 			break;
-		default:
-			pending++;
+		case '\'':
+			quotes = (quotes == Q_SINGLE) ? Q_NONE : Q_SINGLE;
+			builder->has_field = 1;
+			break;
+		case '"':
+			quotes = (quotes == Q_DOUBLE) ? Q_NONE : Q_DOUBLE;
+			builder->has_field = 1;
 			break;
+		case '$':
+			trav = expand_dollar(trav, builder, quotes == Q_DOUBLE);
+			break;
+		}
+	}
+}
+
+/**
+ * @brief Expand a parameter or command substitution.
+ *
+ * @param[in] start - Characters after '$'.
+ * @param[in,out] builder - Receives the value.
+ * @param[in] quoted - Whether the value is protected from splitting.
+ * @return Pointer after the consumed characters.
+ */
+static const char *expand_dollar(
+	const char *start, field_builder *builder, int quoted) {
+	const char *end = start;
+
+	if (*start == '(') {
+		char *command = parse_command(start + 1, &end);
+		if (command == NULL) {
+			push_literal(builder, "$", 1);
+			return start;
 		}
+
+		char *result = subshell_eval(command);
+		if (result != NULL) {
+			push_value(builder, result, quoted);
+		}
+		free(command);
+		free(result);
+		return end;
 	}
 
-	if (pending > 0) {
-		vec_bulk_push(&expanded, input, pending);
+	if (isdigit(*start)) {
+		uint32_t position = strtoul(start, (char **)&end, 10);
+		const char *value = scope_get_pos(position);
+		if (value != NULL) {
+			push_value(builder, value, quoted);
+		}
+		return end;
 	}
 
-	// Null-terminate string
-	vec_push(&expanded, &null_char);
-	*output = vec_collect(&expanded);
-	return 0;
+	char *var_name = parse_variable(start, &end);
+	if (*var_name == '\0') {
+		// Lone dollar sign
+		push_literal(builder, "$", 1);
+	} else {
+		// Try scope first, then check the environment
+		const char *value = scope_get_var(var_name);
+		if (value == NULL) {
+			value = vars_get(var_name);
+		}
+
+		if (value != NULL) {
+			push_value(builder, value, quoted);
+		}
+	}
+
+	free(var_name);
+	return end;
+}
+
+/**
+ * @brief Append characters to the current field.
+ *
+ * @param[in,out] builder - Field builder.
+ * @param[in] str - Characters.
+ * @param[in] len - Character count.
+ */
+static void push_literal(field_builder *builder, const char *str, size_t len) {
+	vec_bulk_push(&builder->current, str, len);
+	builder->has_field = 1;
+}
+
+/**
+ * @brief Append expanded value, splitting it if unquoted.
+ *
+ * @param[in,out] builder - Field builder.
+ * @param[in] value - Expanded value.
+ * @param[in] quoted - Whether the value is protected from splitting.
+ */
+static void push_value(field_builder *builder, const char *value, int quoted) {
+	if (quoted || builder->fields == NULL) {
+		push_literal(builder, value, strlen(value));
+		return;
+	}
+
+	while (*value != '\0') {
+		size_t run = scan_span(value, IFS_CHARS);
+		if (run > 0) {
+			push_literal(builder, value, run);
+			value += run;
+		}
+
+		size_t gap = strspn(value, IFS_CHARS);
+		if (gap > 0) {
+			end_field(builder);
+			value += gap;
+		}
+	}
+}
+
+/**
+ * @brief Finish the current field, if any.
+ *
+ * @param[in,out] builder - Field builder.
+ */
+static void end_field(field_builder *builder) {
+	if (!builder->has_field) {
+		return;
+	}
+
+	vec_push(&builder->current, &null_char);
+	char *field = vec_collect(&builder->current);
+	vec_push(builder->fields, &field);
+
+	builder->current = vec_init(sizeof(char));
+	builder->has_field = 0;
 }
 
 /**
@@ -230,32 +430,179 @@ static char *parse_variable(const char *start, const char **end) {
  * @brief Evaluate a command in a subshell.
  *
  * @param[in] command - Command to run.
- * @return Command output.
+ * @return Command output; NULL if empty.
  */
 static char *subshell_eval(const char *command) {
+	if (command == NULL) {
+		return NULL;
+	}
+
+	// Parse once in the parent
+	ast_node *root = parse_cached(command);
+	if (root == NULL) {
+		return NULL;
+	}
+
+	char *output;
+	if (eval_is_pure(root)) {
+		output = capture_in_process(root);
+	} else {
+		output = capture_subshell(root);
+	}
+	parse_release(root);
+
+	if (output == NULL) {
+		return NULL;
+	}
+
+	// Trailing newlines are removed
+	size_t length = strlen(output);
+	while (length > 0 && output[length - 1] == '\n') {
+		output[--length] = '\0';
+	}
+
+	if (length == 0) {
+		free(output);
+		return NULL;
+	}
+
+	return output;
+}
+
+/**
+ * @brief Run command in a forked subshell.
+ *
+ * @param[in] root - Parsed command.
+ * @return Command output; NULL on error.
+ * @note Allocated return value.
+ */
+static char *capture_subshell(ast_node *root) {
 	int pipe_fds[2];
 	if (pipe(pipe_fds) < 0) {
 		return NULL;
 	}
 
-	exec_subshell(command, pipe_fds[1]);
-
-	char_vector output = vec_init(sizeof(char));
-	char rd_buf[RD_BUF_LEN];
-	ssize_t size;
-	while ((size = read(pipe_fds[0], rd_buf, RD_BUF_LEN)) > 0) {
-		vec_bulk_push(&output, rd_buf, size);
+	pid_t pid = exec_subshell(root, pipe_fds[1]);
+	close(pipe_fds[1]);
+	if (pid < 0) {
+		close(pipe_fds[0]);
+		return NULL;
 	}
 
+	// Read while the child is running, then collect it
+	char *output = read_all(pipe_fds[0], 0);
 	close(pipe_fds[0]);
-	close(pipe_fds[1]);
+	child_collect(pid);
+
+	return output;
+}
+
+/**
+ * @brief Run a pure built-in without forking.
+ *
+ * @param[in] root - Parsed command.
+ * @return Command output; NULL on error.
+ * @note Allocated return value.
+ */
+static char *capture_in_process(ast_node *root) {
+	// A pipe could fill up, since nobody reads it while the built-in runs
+	int out_fd = open_memfd();
+	if (out_fd < 0) {
+		return capture_subshell(root);
+	}
+
+	run_flags flags = {
+		.redirs = vec_init(sizeof(redir)),
+		.assigns = vec_init(sizeof(assign)),
+	};
+	redir output = {
+		.type = RDR_FD,
+		.flags = 0,
+		.from = STDOUT_FILENO,
+		.to.fd = out_fd,
+	};
+	vec_push(&flags.redirs, &output);
+
+	eval_ast_flags(root, &flags);
+	del_flags(&flags);
+
+	// Size is known up front
+	struct stat out_info;
+	size_t size_hint = 0;
+	if (fstat(out_fd, &out_info) == 0) {
+		size_hint = out_info.st_size;
+	}
+
+	lseek(out_fd, 0, SEEK_SET);
+	char *result = read_all(out_fd, size_hint);
+	close(out_fd);
+
+	return result;
+}
+
+/**
+ * @brief Create an anonymous in-memory file.
+ *
+ * @return File descriptor; -1 if not supported.
+ */
+static int open_memfd(void) {
+#ifdef HAVE_MEMFD
+	return syscall(SYS_memfd_create, "mesh-subst", MFD_CLOEXEC);
+#else
+	return -1;
+#endif
+}
+
+/**
+ * @brief Read file descriptor until end of file.
+ *
+ * @param[in] fd - File descriptor.
+ * @param[in] size_hint - Expected size; 0 if unknown.
+ * @return Null-terminated data; NULL on error.
+ * @note Allocated return value.
+ */
+static char *read_all(int fd, size_t size_hint) {
+	// One byte past the limit is enough to tell it was exceeded
+	const size_t max_capacity = (size_t)CAPTURE_MAX_LEN + 2;
+
+	size_t capacity = (size_hint > 0) ? size_hint + 1 : RD_BUF_LEN;
+	if (capacity > max_capacity) {
+		capacity = max_capacity;
+	}
+
+	size_t length = 0;
+	char *data = malloc(capacity);
+
+	while (1) {
+		// Grow exponentially, keeping room for the null-terminator
+		if (length + 1 == capacity) {
+			if (capacity == max_capacity) {
+				break;
+			}
+
+			capacity = (capacity < max_capacity / 2) ? capacity * 2
+													 : max_capacity;
+			data = realloc(data, capacity);
+		}
+
+		ssize_t size = read(fd, data + length, capacity - length - 1);
+		if (size < 0 && errno == EINTR) {
+			continue;
+		}
+		if (size <= 0) {
+			break;
+		}
+
+		length += size;
+	}
 
-	if (output.count == 0) {
-		vec_deinit(&output);
+	if (length > CAPTURE_MAX_LEN) {
+		print_error(
+			"command substitution output exceeds %d bytes\n", CAPTURE_MAX_LEN);
+		free(data);
 		return NULL;
 	}
 
-	vec_push(&output, &null_char);
-	char *data = vec_collect(&output);
+	data[length] = '\0';
 	return data;
 }
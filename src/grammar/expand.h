@@ -8,14 +8,30 @@
  */
 #pragma once
 
+#include "../util/helper.h"
+#include "ast.h"
+
 /**
- * @brief Perform all expansions.
+ * @brief Perform all expansions and remove quotes, without field splitting.
  *
- * @param[in] word - Input string.
+ * @param[in] word - Input string; NULL for empty.
  * @return Expanded string.
+ * @note Allocated return value.
  */
 char *expand_word(const char *word);
 
+/**
+ * @brief Expand a word into argument fields.
+ *
+ * @param[in] word - Word AST node.
+ * @param[in,out] fields - Receives the fields.
+ * @param[in,out] owned - Receives fields allocated by the expansion.
+ * @note Words that need no expansion are passed through without a copy,
+ * so fields must be treated as read-only.
+ */
+void expand_fields(
+	const ast_node *word, string_vector *fields, string_vector *owned);
+
 /**
  * @brief Make changes to the buffer before the parser is run.
  *
@@ -25,3 +41,11 @@ char *expand_word(const char *word);
  * @note Allocated value placed in output.
  */
 int preprocess_buffer(const char *input, char **output);
+
+/**
+ * @brief Check if preprocess_buffer would change the buffer.
+ *
+ * @param[in] input - Input buffer.
+ * @return 1 if the buffer references context rows; 0 otherwise.
+ */
+int preprocess_needed(const char *input);
@@ -0,0 +1,767 @@
+/**
+ * @file grammar/image.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Precompiled script images.
+ */
+#define _POSIX_C_SOURCE 200809L
+// realpath is not part of base POSIX
+#define _DEFAULT_SOURCE
+#define _DARWIN_C_SOURCE
+#include "image.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <c-utils/vector-ext.h>
+#include <c-utils/vector.h>
+
+#include "../core/vars.h"
+#include "../util/error.h"
+#include "../util/fs.h"
+#include "../util/hashmap.h"
+#include "expand.h"
+#include "input.h"
+#include "parse.h"
+
+#ifdef __APPLE__
+#define st_mtim st_mtimespec
+#endif
+
+// "MSHC"
+#define IMAGE_MAGIC 0x4348534d
+// Bump on any layout change
+#define IMAGE_VERSION 3
+#define NO_INDEX UINT32_MAX
+
+/*
+ * File layout, native byte order (the cache is never shared between hosts):
+ * header, lines, nodes, refs, strings.
+ *
+ * Nodes are stored breadth-first, so children always follow their parent.
+ * A run node's value is an offset into refs, which holds the word,
+ * redirection and assignment counts followed by the node indices.
+ */
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+
+	// Source file identity
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+	uint32_t path;
+
+	uint32_t line_count;
+	uint32_t node_count;
+	uint32_t ref_count;
+	uint32_t str_size;
+} image_header;
+
+typedef struct {
+	uint32_t type;
+	uint32_t text;
+	uint32_t root;
+} image_line_rec;
+
+typedef struct {
+	uint8_t kind;
+	uint8_t flags;
+	uint16_t reserved;
+	// Enum, fd number, string offset or refs offset
+	int32_t value;
+	uint32_t length;
+	uint32_t left;
+	uint32_t right;
+} image_node;
+
+typedef struct {
+	vector lines;
+	vector nodes;
+	vector refs;
+	vector strings;
+} image_writer;
+
+static char *cache_file_path(const char *source_path);
+static int map_cached(script_image *image, const char *cache_path,
+	const char *source_path, const struct stat *info);
+static void compile_source(
+	image_writer *writer, const char *source, size_t length);
+static uint32_t add_string(image_writer *writer, const char *str, size_t len);
+static uint32_t add_tree(image_writer *writer, const ast_node *root);
+static uint32_t enqueue(vector *queue, uint32_t first, const ast_node *node);
+static void *serialize(image_writer *writer, const char *source_path,
+	const struct stat *info, size_t *size);
+static void store_cache(const char *cache_path, const void *data, size_t size);
+static int load_image(script_image *image, void *data, size_t size);
+static int check_node(const image_header *header, const image_node *nodes,
+	const uint32_t *refs, const char *strings, uint32_t index);
+static int check_child(const image_header *header, const image_node *nodes,
+	uint32_t parent, uint32_t child, int kind);
+
+int image_load(int fd, const char *path, script_image *image) {
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		print_error("failed to open file: %s\n", strerror(errno));
+		return -1;
+	}
+
+	char *source_path = realpath(path, NULL);
+	char *cache_path = NULL;
+	if (source_path != NULL) {
+		cache_path = cache_file_path(source_path);
+	}
+
+	if (cache_path != NULL
+		&& map_cached(image, cache_path, source_path, &info) == 0) {
+		free(cache_path);
+		free(source_path);
+		return 0;
+	}
+
+	// Script is compiled straight from the mapping
+	size_t source_size = info.st_size;
+	char *source = NULL;
+	if (source_size > 0) {
+		source = mmap(NULL, source_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+	if (source == MAP_FAILED) {
+		print_error("failed to read file: %s\n", strerror(errno));
+		free(cache_path);
+		free(source_path);
+		return -1;
+	}
+
+	image_writer writer = {
+		.lines = vec_init(sizeof(image_line_rec)),
+		.nodes = vec_init(sizeof(image_node)),
+		.refs = vec_init(sizeof(uint32_t)),
+		.strings = vec_init(sizeof(char)),
+	};
+	compile_source(&writer, source, source_size);
+	if (source != NULL) {
+		munmap(source, source_size);
+	}
+
+	size_t size;
+	const char *identity = (source_path != NULL) ? source_path : path;
+	void *data = serialize(&writer, identity, &info, &size);
+
+	if (cache_path != NULL) {
+		store_cache(cache_path, data, size);
+	}
+	free(cache_path);
+	free(source_path);
+
+	if (load_image(image, data, size) < 0) {
+		print_error("failed to load compiled script\n");
+		free(data);
+		return -1;
+	}
+
+	image->mapped = 0;
+	return 0;
+}
+
+void image_free(script_image *image) {
+	arena_deinit(&image->mem);
+
+	if (image->mapped) {
+		munmap(image->data, image->size);
+	} else {
+		free(image->data);
+	}
+
+	image->lines = NULL;
+	image->count = 0;
+	image->data = NULL;
+}
+
+/** Internal */
+
+/**
+ * @brief Get cache file location for a script.
+ *
+ * @param[in] source_path - Absolute script path.
+ * @return Cache file path; NULL if there is no cache directory.
+ * @note Allocated return value.
+ */
+static char *cache_file_path(const char *source_path) {
+	if (vars_get("HOME") == NULL) {
+		return NULL;
+	}
+
+	const char *cache_dir = fs_conf_cache();
+	if (fs_mkdir_p(cache_dir) < 0) {
+		return NULL;
+	}
+
+	// Collisions are caught by the path stored in the image
+	char name[16];
+	sprintf(name, "%08x.msc", hashmap_hash(source_path));
+
+	char *cache_path = fs_path_malloc();
+	strcpy(cache_path, cache_dir);
+	fs_path_cat(cache_path, name);
+
+	return cache_path;
+}
+
+/**
+ * @brief Map a cached image if it matches the script.
+ *
+ * @param[out] image - Loaded image.
+ * @param[in] cache_path - Cache file path.
+ * @param[in] source_path - Absolute script path.
+ * @param[in] info - Script file status.
+ * @return 0 on success; -1 if missing or out of date.
+ */
+static int map_cached(script_image *image, const char *cache_path,
+	const char *source_path, const struct stat *info) {
+	int fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		return -1;
+	}
+
+	struct stat cache_info;
+	if (fstat(fd, &cache_info) < 0
+		|| (size_t)cache_info.st_size < sizeof(image_header)) {
+		close(fd);
+		return -1;
+	}
+
+	size_t size = cache_info.st_size;
+	void *data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return -1;
+	}
+
+	const image_header *header = data;
+	if (header->magic != IMAGE_MAGIC || header->version != IMAGE_VERSION
+		|| header->mtime_sec != (int64_t)info->st_mtim.tv_sec
+		|| header->mtime_nsec != (int64_t)info->st_mtim.tv_nsec
+		|| header->size != (int64_t)info->st_size
+		|| header->str_size == 0
+		|| header->str_size > size - sizeof(image_header)
+		|| header->path >= header->str_size) {
+		munmap(data, size);
+		return -1;
+	}
+
+	// String table is last and null-terminated
+	const char *strings = (const char *)data + size - header->str_size;
+	if (strings[header->str_size - 1] != '\0'
+		|| strcmp(strings + header->path, source_path) != 0) {
+		munmap(data, size);
+		return -1;
+	}
+
+	if (load_image(image, data, size) < 0) {
+		munmap(data, size);
+		return -1;
+	}
+
+	image->mapped = 1;
+	return 0;
+}
+
+/**
+ * @brief Parse every command of the script into the image.
+ *
+ * @param[in,out] writer - Image being built.
+ * @param[in] source - Script source.
+ * @param[in] length - Source length.
+ */
+static void compile_source(
+	image_writer *writer, const char *source, size_t length) {
+	arena mem = arena_init();
+
+	input_split_state split = { 0 };
+	size_t offset = 0;
+	while (offset < length) {
+		size_t cmd_length =
+			input_split(source + offset, length - offset, 1, &split);
+		const char *start = source + offset;
+		offset += cmd_length;
+
+		if (start[cmd_length - 1] == '\n') {
+			cmd_length--;
+		}
+
+		// Mapping is read-only and not null-terminated
+		char *command = arena_alloc(&mem, cmd_length + 1);
+		memcpy(command, start, cmd_length);
+		command[cmd_length] = '\0';
+
+		image_line_rec rec = {
+			.type = IMAGE_LINE_TEXT,
+			.text = add_string(writer, command, cmd_length),
+			.root = NO_INDEX,
+		};
+
+		// Context rows can change between runs, so those lines stay as text
+		ast_node *root;
+		if (input_is_blank(command)) {
+			rec.type = IMAGE_LINE_EMPTY;
+		} else if (!preprocess_needed(command)
+			&& parse_tree(command, &mem, &root) == 0 && root != NULL) {
+			rec.type = IMAGE_LINE_TREE;
+			rec.root = add_tree(writer, root);
+		}
+
+		vec_push(&writer->lines, &rec);
+		arena_reset(&mem);
+	}
+
+	arena_deinit(&mem);
+}
+
+/**
+ * @brief Add a string to the string table.
+ *
+ * @param[in,out] writer - Image being built.
+ * @param[in] str - String.
+ * @param[in] len - String length.
+ * @return String offset.
+ */
+static uint32_t add_string(image_writer *writer, const char *str, size_t len) {
+	static const char null_char = '\0';
+
+	uint32_t offset = writer->strings.count;
+	vec_bulk_push(&writer->strings, str, len);
+	vec_push(&writer->strings, &null_char);
+
+	return offset;
+}
+
+/**
+ * @brief Flatten a tree into the node table.
+ *
+ * @param[in,out] writer - Image being built.
+ * @param[in] root - Tree root.
+ * @return Index of the root node.
+ */
+static uint32_t add_tree(image_writer *writer, const ast_node *root) {
+	uint32_t first = writer->nodes.count;
+
+	// Breadth-first; a node's index is known as soon as it is queued
+	vector queue = vec_init(sizeof(ast_node *));
+	vec_push(&queue, &root);
+
+	for (uint32_t i = 0; i < queue.count; i++) {
+		const ast_node *const *item = vec_at(&queue, i);
+		const ast_node *node = *item;
+
+		image_node rec = {
+			.kind = node->kind,
+			.flags = node->flags,
+			.reserved = 0,
+			.value = 0,
+			.length = 0,
+			.left = NO_INDEX,
+			.right = NO_INDEX,
+		};
+
+		switch (node->kind) {
+		case AST_KIND_SEQ:
+			rec.value = node->value.seq;
+			break;
+		case AST_KIND_COND:
+			rec.value = node->value.cond;
+			break;
+		case AST_KIND_RDR:
+			rec.value = node->value.rdr;
+			break;
+		case AST_KIND_FDNUM:
+			rec.value = node->value.fdnum;
+			break;
+		case AST_KIND_WORD:
+		case AST_KIND_ASSIGN:
+			rec.value = add_string(writer, node->value.str, node->length);
+			rec.length = node->length;
+			break;
+		case AST_KIND_PIPE:
+			break;
+		case AST_KIND_RUN: {
+			const ast_command *cmd = node->value.cmd;
+			rec.value = writer->refs.count;
+
+			vec_push(&writer->refs, &cmd->word_count);
+			vec_push(&writer->refs, &cmd->redir_count);
+			vec_push(&writer->refs, &cmd->assign_count);
+			for (uint32_t j = 0; j < cmd->word_count; j++) {
+				uint32_t index = enqueue(&queue, first, cmd->words[j]);
+				vec_push(&writer->refs, &index);
+			}
+			for (uint32_t j = 0; j < cmd->redir_count; j++) {
+				uint32_t index = enqueue(&queue, first, cmd->redirs[j]);
+				vec_push(&writer->refs, &index);
+			}
+			for (uint32_t j = 0; j < cmd->assign_count; j++) {
+				uint32_t index = enqueue(&queue, first, cmd->assigns[j]);
+				vec_push(&writer->refs, &index);
+			}
+			break;
+		}
+		}
+
+		rec.left = enqueue(&queue, first, node->left);
+		rec.right = enqueue(&queue, first, node->right);
+		vec_push(&writer->nodes, &rec);
+	}
+
+	vec_deinit(&queue);
+	return first;
+}
+
+/**
+ * @brief Queue a child node for flattening.
+ *
+ * @param[in,out] queue - Node queue.
+ * @param[in] first - Index of the first queued node in the node table.
+ * @param[in] node - Child node; may be NULL.
+ * @return Index the node will have; NO_INDEX for NULL.
+ */
+static uint32_t enqueue(vector *queue, uint32_t first, const ast_node *node) {
+	if (node == NULL) {
+		return NO_INDEX;
+	}
+
+	uint32_t index = first + queue->count;
+	vec_push(queue, &node);
+	return index;
+}
+
+/**
+ * @brief Write out the image.
+ *
+ * @param[in] writer - Image being built; freed.
+ * @param[in] source_path - Script path.
+ * @param[in] info - Script file status.
+ * @param[out] size - Image size.
+ * @return Image data.
+ * @note Allocated return value.
+ */
+static void *serialize(image_writer *writer, const char *source_path,
+	const struct stat *info, size_t *size) {
+	uint32_t path = add_string(writer, source_path, strlen(source_path));
+	image_header header = {
+		.magic = IMAGE_MAGIC,
+		.version = IMAGE_VERSION,
+		.mtime_sec = info->st_mtim.tv_sec,
+		.mtime_nsec = info->st_mtim.tv_nsec,
+		.size = info->st_size,
+		.path = path,
+		.line_count = writer->lines.count,
+		.node_count = writer->nodes.count,
+		.ref_count = writer->refs.count,
+		.str_size = writer->strings.count,
+	};
+
+	size_t lines_size = header.line_count * sizeof(image_line_rec);
+	size_t nodes_size = header.node_count * sizeof(image_node);
+	size_t refs_size = header.ref_count * sizeof(uint32_t);
+	*size = sizeof(header) + lines_size + nodes_size + refs_size
+		+ header.str_size;
+
+	char *data = malloc(*size);
+	char *trav = data;
+	memcpy(trav, &header, sizeof(header));
+	trav += sizeof(header);
+
+	// Empty vectors may have no storage
+	if (lines_size > 0) {
+		memcpy(trav, vec_at(&writer->lines, 0), lines_size);
+		trav += lines_size;
+	}
+	if (nodes_size > 0) {
+		memcpy(trav, vec_at(&writer->nodes, 0), nodes_size);
+		trav += nodes_size;
+	}
+	if (refs_size > 0) {
+		memcpy(trav, vec_at(&writer->refs, 0), refs_size);
+		trav += refs_size;
+	}
+	memcpy(trav, vec_at(&writer->strings, 0), header.str_size);
+
+	vec_deinit(&writer->lines);
+	vec_deinit(&writer->nodes);
+	vec_deinit(&writer->refs);
+	vec_deinit(&writer->strings);
+
+	return data;
+}
+
+/**
+ * @brief Save an image to the cache, replacing it atomically.
+ *
+ * @param[in] cache_path - Cache file path.
+ * @param[in] data - Image data.
+ * @param[in] size - Image size.
+ * @note Failures are ignored; the script still runs.
+ */
+static void store_cache(const char *cache_path, const void *data, size_t size) {
+	char *temp_path = malloc(strlen(cache_path) + 32);
+	sprintf(temp_path, "%s.%ld.tmp", cache_path, (long)getpid());
+
+	int fd = open(temp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if (fd < 0) {
+		free(temp_path);
+		return;
+	}
+
+	const char *trav = data;
+	size_t left = size;
+	while (left > 0) {
+		ssize_t written = write(fd, trav, left);
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			break;
+		}
+
+		trav += written;
+		left -= written;
+	}
+
+	if (close(fd) < 0 || left > 0 || rename(temp_path, cache_path) < 0) {
+		unlink(temp_path);
+	}
+
+	free(temp_path);
+}
+
+/**
+ * @brief Validate an image and build its trees.
+ *
+ * @param[out] image - Loaded image.
+ * @param[in] data - Image data; kept by the image.
+ * @param[in] size - Image size.
+ * @return 0 on success; -1 if the image is malformed.
+ */
+static int load_image(script_image *image, void *data, size_t size) {
+	const image_header *header = data;
+
+	// Section bounds, computed in 64 bits so they cannot overflow
+	uint64_t lines_at = sizeof(image_header);
+	uint64_t nodes_at =
+		lines_at + (uint64_t)header->line_count * sizeof(image_line_rec);
+	uint64_t refs_at =
+		nodes_at + (uint64_t)header->node_count * sizeof(image_node);
+	uint64_t strings_at = refs_at + (uint64_t)header->ref_count * 4;
+	if (strings_at + header->str_size != size || header->str_size == 0) {
+		return -1;
+	}
+
+	const char *base = data;
+	const image_line_rec *lines = (const image_line_rec *)(base + lines_at);
+	const image_node *nodes = (const image_node *)(base + nodes_at);
+	const uint32_t *refs = (const uint32_t *)(base + refs_at);
+	const char *strings = base + strings_at;
+
+	if (strings[header->str_size - 1] != '\0') {
+		return -1;
+	}
+	for (uint32_t i = 0; i < header->node_count; i++) {
+		if (check_node(header, nodes, refs, strings, i) < 0) {
+			return -1;
+		}
+	}
+
+	image->mem = arena_init();
+	ast_node *built =
+		arena_alloc(&image->mem, header->node_count * sizeof(ast_node));
+
+	// Children always follow their parent, so one pass links everything
+	for (uint32_t i = 0; i < header->node_count; i++) {
+		const image_node *rec = nodes + i;
+		ast_node *node = built + i;
+
+		node->kind = rec->kind;
+		node->flags = rec->flags;
+		node->length = rec->length;
+		node->left = (rec->left != NO_INDEX) ? built + rec->left : NULL;
+		node->right = (rec->right != NO_INDEX) ? built + rec->right : NULL;
+
+		switch (rec->kind) {
+		case AST_KIND_SEQ:
+			node->value.seq = rec->value;
+			break;
+		case AST_KIND_COND:
+			node->value.cond = rec->value;
+			break;
+		case AST_KIND_RDR:
+			node->value.rdr = rec->value;
+			break;
+		case AST_KIND_FDNUM:
+			node->value.fdnum = rec->value;
+			break;
+		case AST_KIND_WORD:
+		case AST_KIND_ASSIGN:
+			// Strings are used straight from the image
+			node->value.str = strings + (uint32_t)rec->value;
+			break;
+		case AST_KIND_PIPE:
+			node->value.str = NULL;
+			break;
+		case AST_KIND_RUN: {
+			const uint32_t *ref = refs + (uint32_t)rec->value;
+			ast_command *cmd = arena_alloc(&image->mem, sizeof(ast_command));
+			cmd->word_count = ref[0];
+			cmd->redir_count = ref[1];
+			cmd->assign_count = ref[2];
+
+			uint32_t total =
+				cmd->word_count + cmd->redir_count + cmd->assign_count;
+			ast_node **parts =
+				arena_alloc(&image->mem, total * sizeof(ast_node *));
+			for (uint32_t j = 0; j < total; j++) {
+				parts[j] = built + ref[3 + j];
+			}
+
+			cmd->words = parts;
+			cmd->redirs = parts + cmd->word_count;
+			cmd->assigns = cmd->redirs + cmd->redir_count;
+			node->value.cmd = cmd;
+			break;
+		}
+		}
+	}
+
+	image->count = header->line_count;
+	image->lines =
+		arena_alloc(&image->mem, header->line_count * sizeof(image_line));
+	for (uint32_t i = 0; i < header->line_count; i++) {
+		const image_line_rec *rec = lines + i;
+		if (rec->text >= header->str_size || rec->type > IMAGE_LINE_TEXT
+			|| (rec->type == IMAGE_LINE_TREE
+				&& rec->root >= header->node_count)) {
+			arena_deinit(&image->mem);
+			return -1;
+		}
+
+		image->lines[i].type = rec->type;
+		image->lines[i].text = strings + rec->text;
+		image->lines[i].root =
+			(rec->type == IMAGE_LINE_TREE) ? built + rec->root : NULL;
+	}
+
+	image->data = data;
+	image->size = size;
+	return 0;
+}
+
+/**
+ * @brief Check that a node only refers to valid data.
+ *
+ * @param[in] header - Image header.
+ * @param[in] nodes - Node table.
+ * @param[in] refs - Command reference table.
+ * @param[in] strings - String table.
+ * @param[in] index - Node index.
+ * @return 0 if valid; -1 otherwise.
+ */
+static int check_node(const image_header *header, const image_node *nodes,
+	const uint32_t *refs, const char *strings, uint32_t index) {
+	const image_node *rec = nodes + index;
+
+	// Children are optional in general, required ones are checked below
+	if ((rec->left != NO_INDEX
+			&& check_child(header, nodes, index, rec->left, -1) < 0)
+		|| (rec->right != NO_INDEX
+			&& check_child(header, nodes, index, rec->right, -1) < 0)) {
+		return -1;
+	}
+
+	switch (rec->kind) {
+	case AST_KIND_SEQ:
+		return check_child(header, nodes, index, rec->left, -1);
+	case AST_KIND_COND:
+	case AST_KIND_PIPE:
+		if (check_child(header, nodes, index, rec->left, -1) < 0) {
+			return -1;
+		}
+		return check_child(header, nodes, index, rec->right, -1);
+	case AST_KIND_RDR:
+		if (check_child(header, nodes, index, rec->left, AST_KIND_FDNUM) < 0) {
+			return -1;
+		}
+		return check_child(header, nodes, index, rec->right, AST_KIND_WORD);
+	case AST_KIND_FDNUM:
+		return 0;
+	case AST_KIND_WORD:
+	case AST_KIND_ASSIGN: {
+		uint64_t end = (uint64_t)(uint32_t)rec->value + rec->length;
+		if (end >= header->str_size || strings[end] != '\0') {
+			return -1;
+		}
+		return 0;
+	}
+	case AST_KIND_RUN: {
+		uint64_t start = (uint32_t)rec->value;
+		if (start + 3 > header->ref_count) {
+			return -1;
+		}
+
+		const uint32_t *ref = refs + start;
+		uint64_t words = ref[0];
+		uint64_t redirs = words + ref[1];
+		uint64_t total = redirs + ref[2];
+		if (start + 3 + total > header->ref_count) {
+			return -1;
+		}
+
+		// Evaluation relies on the kind of each part
+		for (uint64_t i = 0; i < total; i++) {
+			int kind = AST_KIND_ASSIGN;
+			if (i < words) {
+				kind = AST_KIND_WORD;
+			} else if (i < redirs) {
+				kind = AST_KIND_RDR;
+			}
+
+			if (check_child(header, nodes, index, ref[3 + i], kind) < 0) {
+				return -1;
+			}
+		}
+		return 0;
+	}
+	default:
+		return -1;
+	}
+}
+
+/**
+ * @brief Check a required child reference.
+ *
+ * @param[in] header - Image header.
+ * @param[in] nodes - Node table.
+ * @param[in] parent - Parent node index.
+ * @param[in] child - Child node index.
+ * @param[in] kind - Required node kind; -1 for any.
+ * @return 0 if valid; -1 otherwise.
+ */
+static int check_child(const image_header *header, const image_node *nodes,
+	uint32_t parent, uint32_t child, int kind) {
+	// Forward references only, so trees cannot loop
+	if (child <= parent || child >= header->node_count) {
+		return -1;
+	}
+	if (kind >= 0 && nodes[child].kind != kind) {
+		return -1;
+	}
+
+	return 0;
+}
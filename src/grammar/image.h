@@ -0,0 +1,62 @@
+/**
+ * @file grammar/image.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Precompiled script images.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../util/arena.h"
+#include "ast.h"
+
+typedef enum {
+	// Nothing to run
+	IMAGE_LINE_EMPTY,
+	// Parsed ahead of time
+	IMAGE_LINE_TREE,
+	// Parsed when run (context references, syntax errors)
+	IMAGE_LINE_TEXT,
+} image_line_type;
+
+typedef struct {
+	image_line_type type;
+	// Source line
+	const char *text;
+	// Tree for IMAGE_LINE_TREE; NULL otherwise
+	ast_node *root;
+} image_line;
+
+typedef struct {
+	image_line *lines;
+	uint32_t count;
+
+	// Serialized image; strings point into it
+	void *data;
+	size_t size;
+	int mapped;
+	// Owns lines and nodes
+	arena mem;
+} script_image;
+
+/**
+ * @brief Load a script, reusing its cached image if the file is unchanged.
+ *
+ * @param[in] fd - Open script file; must be a regular file.
+ * @param[in] path - Script path.
+ * @param[out] image - Loaded image.
+ * @return 0 on success; -1 on error.
+ * @note Trees are read-only and live until image_free.
+ */
+int image_load(int fd, const char *path, script_image *image);
+
+/**
+ * @brief Free a loaded image.
+ *
+ * @param[in] image - Loaded image.
+ */
+void image_free(script_image *image);
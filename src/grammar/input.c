@@ -0,0 +1,286 @@
+/**
+ * @file grammar/input.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Non-interactive command input.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "input.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../util/error.h"
+
+static void sync_offset(input_reader *reader);
+static int fill_buffer(input_reader *reader);
+
+size_t input_split(
+	const char *text, size_t length, int at_eof, input_split_state *state) {
+	size_t i;
+	for (i = state->scanned; i < length; i++) {
+		if (state->in_comment) {
+			// Comment runs up to the newline
+			const char *end = memchr(text + i, '\n', length - i);
+			if (end == NULL) {
+				i = length;
+				break;
+			}
+
+			i = (size_t)(end - text);
+			state->in_comment = 0;
+		}
+
+		char c = text[i];
+
+		// Escapes and operators depend on the next character
+		if (i + 1 == length && !at_eof && c != '\0'
+			&& strchr("\\|&<>", c) != NULL) {
+			break;
+		}
+
+		// Same as the lexer: an escape never covers a newline
+		if (c == '\\' && i + 1 < length && text[i + 1] != '\n') {
+			state->open_op = 0;
+			state->in_word = 1;
+			i++;
+			continue;
+		}
+
+		if (state->quote != '\0') {
+			if (c == state->quote) {
+				state->quote = '\0';
+			}
+			continue;
+		}
+
+		// Operators and blanks end the word
+		int word_char = 0;
+		switch (c) {
+		case '\n':
+			if (!state->open_op) {
+				memset(state, 0, sizeof(input_split_state));
+				return i + 1;
+			}
+			break;
+		case ' ':
+		case '\t':
+			break;
+		case '#':
+			if (!state->in_word) {
+				state->in_comment = 1;
+				break;
+			}
+			word_char = 1;
+			state->open_op = 0;
+			break;
+		case '\'':
+		case '"':
+			state->quote = c;
+			word_char = 1;
+			state->open_op = 0;
+			break;
+		case '|':
+		case '&':
+			if (i + 1 < length && text[i + 1] == c) {
+				state->open_op = 1;
+				i++;
+			} else {
+				// Single '&' ends the command
+				state->open_op = (c == '|');
+			}
+			break;
+		case ';':
+			state->open_op = 0;
+			break;
+		case '>':
+		case '<':
+			// Two-character redirection operators
+			if (i + 1 < length && strchr("|&>", text[i + 1]) != NULL) {
+				i++;
+			}
+			state->open_op = 0;
+			break;
+		default:
+			word_char = 1;
+			state->open_op = 0;
+			break;
+		}
+
+		state->in_word = word_char;
+	}
+
+	// Unfinished command is handed to the parser as is
+	if (at_eof) {
+		memset(state, 0, sizeof(input_split_state));
+		return length;
+	}
+
+	state->scanned = i;
+	return 0;
+}
+
+input_reader input_init(int fd) {
+	input_reader reader = {
+		.fd = fd,
+		.eof = 0,
+		.rewind = 0,
+		.by_byte = 0,
+		.offset = 0,
+		.buffer = malloc(INPUT_BLOCK_SIZE + 1),
+		.capacity = INPUT_BLOCK_SIZE + 1,
+		.start = 0,
+		.end = 0,
+		.split = { 0 },
+	};
+
+	if (fd == STDIN_FILENO) {
+		reader.offset = lseek(fd, 0, SEEK_CUR);
+		reader.rewind = (reader.offset >= 0);
+		reader.by_byte = !reader.rewind;
+	}
+
+	return reader;
+}
+
+input_reader input_init_string(const char *text) {
+	size_t length = strlen(text);
+	input_reader reader = {
+		.fd = -1,
+		.eof = 1,
+		.rewind = 0,
+		.by_byte = 0,
+		.offset = 0,
+		.buffer = malloc(length + 1),
+		.capacity = length + 1,
+		.start = 0,
+		.end = length,
+		.split = { 0 },
+	};
+
+	memcpy(reader.buffer, text, length + 1);
+	return reader;
+}
+
+int input_next(input_reader *reader, char **command) {
+	if (reader->rewind) {
+		sync_offset(reader);
+	}
+
+	while (1) {
+		char *text = reader->buffer + reader->start;
+		size_t length = reader->end - reader->start;
+
+		size_t cmd_length =
+			input_split(text, length, reader->eof, &reader->split);
+		if (cmd_length > 0) {
+			reader->start += cmd_length;
+
+			// There is always room for a terminator past the end
+			if (text[cmd_length - 1] == '\n') {
+				cmd_length--;
+			}
+			text[cmd_length] = '\0';
+
+			if (input_is_blank(text)) {
+				continue;
+			}
+
+			// Hand the rest of the input to the command
+			if (reader->rewind) {
+				off_t unread = reader->end - reader->start;
+				lseek(reader->fd, reader->offset - unread, SEEK_SET);
+			}
+
+			*command = text;
+			return 1;
+		}
+
+		if (reader->eof) {
+			return 0;
+		}
+		if (fill_buffer(reader) < 0) {
+			return -1;
+		}
+	}
+}
+
+int input_is_blank(const char *command) {
+	char first = command[strspn(command, " \t")];
+	return first == '\0' || first == '#';
+}
+
+void input_deinit(input_reader *reader) {
+	free(reader->buffer);
+	reader->buffer = NULL;
+}
+
+/** Internal */
+
+/**
+ * @brief Restore the file offset after a command ran.
+ *
+ * @param[in,out] reader - Reader object.
+ */
+static void sync_offset(input_reader *reader) {
+	off_t consumed = reader->offset - (off_t)(reader->end - reader->start);
+	off_t current = lseek(reader->fd, 0, SEEK_CUR);
+
+	// Nothing was read by the command; buffered input is still valid
+	if (current == consumed) {
+		lseek(reader->fd, reader->offset, SEEK_SET);
+		return;
+	}
+
+	// Continue wherever the command stopped reading
+	reader->start = 0;
+	reader->end = 0;
+	reader->eof = 0;
+	reader->offset = current;
+}
+
+/**
+ * @brief Read the next block of input.
+ *
+ * @param[in,out] reader - Reader object.
+ * @return 0 on success; -1 on error.
+ */
+static int fill_buffer(input_reader *reader) {
+	// Keep only the unfinished command
+	size_t pending = reader->end - reader->start;
+	if (reader->start > 0) {
+		memmove(reader->buffer, reader->buffer + reader->start, pending);
+		reader->start = 0;
+		reader->end = pending;
+	}
+
+	// Long commands grow the buffer, so reads are always a full block
+	if (reader->capacity - pending - 1 < INPUT_BLOCK_SIZE) {
+		reader->capacity = pending + INPUT_BLOCK_SIZE + 1;
+		reader->buffer = realloc(reader->buffer, reader->capacity);
+	}
+
+	// Unseekable stdin is not read past the end of the command
+	size_t limit = reader->by_byte ? 1 : INPUT_BLOCK_SIZE;
+
+	ssize_t size;
+	do {
+		size = read(reader->fd, reader->buffer + pending, limit);
+	} while (size < 0 && errno == EINTR);
+
+	if (size < 0) {
+		print_error("failed to read input: %s\n", strerror(errno));
+		return -1;
+	}
+	if (size == 0) {
+		reader->eof = 1;
+	}
+
+	reader->end += size;
+	reader->offset += size;
+	return 0;
+}
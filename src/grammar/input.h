@@ -0,0 +1,107 @@
+/**
+ * @file grammar/input.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Non-interactive command input.
+ */
+#pragma once
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// Read size for non-interactive input
+#define INPUT_BLOCK_SIZE (64 * 1024)
+
+// Scanner state kept between calls, so long commands are scanned once
+typedef struct {
+	// Bytes of the current command already scanned
+	size_t scanned;
+	char quote;
+	// Last token was '&&', '||' or '|'
+	int open_op;
+	// Inside a word, where '#' does not start a comment
+	int in_word;
+	int in_comment;
+} input_split_state;
+
+typedef struct {
+	int fd;
+	int eof;
+	// Stdin is shared with the commands being run, so they must not lose
+	// input read ahead: seekable input is rewound, pipes are read bytewise
+	int rewind;
+	int by_byte;
+	// File offset of the buffer end (with rewind)
+	off_t offset;
+
+	char *buffer;
+	size_t capacity;
+	// Unconsumed input is [start, end)
+	size_t start;
+	size_t end;
+
+	input_split_state split;
+} input_reader;
+
+/**
+ * @brief Find the end of the first complete command.
+ *
+ * @param[in] text - Input text.
+ * @param[in] length - Text length.
+ * @param[in] at_eof - No more input will follow.
+ * @param[in,out] state - Zeroed before the first call for a command; reset
+ * when a command is found.
+ * @return Command length, including the terminating newline;
+ * 0 if more input is needed.
+ * @note Commands continue past newlines inside quotes and after '&&', '||'
+ * and '|'.
+ * @note After returning 0, call again with the same text and more input
+ * appended; scanning resumes where it stopped.
+ */
+size_t input_split(
+	const char *text, size_t length, int at_eof, input_split_state *state);
+
+/**
+ * @brief Create a reader for a file descriptor.
+ *
+ * @param[in] fd - Readable file descriptor.
+ * @return Reader object.
+ */
+input_reader input_init(int fd);
+
+/**
+ * @brief Create a reader over a string (e.g. a '-c' argument).
+ *
+ * @param[in] text - Null-terminated commands; copied.
+ * @return Reader object.
+ */
+input_reader input_init_string(const char *text);
+
+/**
+ * @brief Get the next non-empty command.
+ *
+ * @param[in,out] reader - Reader object.
+ * @param[out] command - Null-terminated command, without the newline.
+ * @return 1 on success; 0 at end of input; -1 on error.
+ * @note Command is valid until the next call.
+ * @note For stdin, the file offset is left right after the command, so it
+ * can read the rest of the input.
+ */
+int input_next(input_reader *reader, char **command);
+
+/**
+ * @brief Check if a command has nothing to run (blanks or a comment).
+ *
+ * @param[in] command - Command from input_split.
+ * @return Boolean result.
+ */
+int input_is_blank(const char *command);
+
+/**
+ * @brief Free reader buffer (does not close the file descriptor).
+ *
+ * @param[in,out] reader - Reader object.
+ */
+void input_deinit(input_reader *reader);
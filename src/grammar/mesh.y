@@ -13,11 +13,11 @@
 	#include <stdlib.h>
 
 	#include "ast.h"
-
-	extern int yylex();
-	void yyerror(ast_node **root, const char *msg);
 %}
 
+%require "2.7"
+%define api.pure full
+
 %union {
 	ast_node *node;
 
@@ -25,7 +25,15 @@
 	ast_seq_value seq;
 }
 
-%parse-param {ast_node **root}
+%code {
+	int yylex(YYSTYPE *lvalp, void *scanner);
+	void yyerror(void *scanner, ast_builder *builder, ast_node **root,
+		const char *msg);
+}
+
+// Parser state is passed explicitly; nothing is global
+%lex-param {void *scanner}
+%parse-param {void *scanner} {ast_builder *builder} {ast_node **root}
 
 // Primary tokens
 %token <node> FDNUM
@@ -62,9 +70,6 @@
 %type <node> cond_list
 %type <node> unit
 %type <node> command
-%type <node> prefix
-%type <node> body
-%type <node> redirect_list
 %type <node> redirect
 %type <rdr> redirect_op
 %type <seq> separator
@@ -77,65 +82,50 @@ program: break list break { *root = $2; }
 	   | break { *root = NULL; }
 	   ;
 
-list: list separator cond_list { $$ = ast_make_seq($2, $1, $3); }
-	| list separator { $$ = ast_make_seq($2, $1, NULL); }
+list: list separator cond_list { $$ = ast_make_seq(builder, $2, $1, $3); }
+	| list separator { $$ = ast_make_seq(builder, $2, $1, NULL); }
 	| cond_list { $$ = $1; }
 	;
 
 cond_list: cond_list LS_AND break unit {
-	$$ = ast_make_cond(AST_COND_AND, $1, $4);
+	$$ = ast_make_cond(builder, AST_COND_AND, $1, $4);
 }
 		 | cond_list LS_OR break unit {
-	$$ = ast_make_cond(AST_COND_OR, $1, $4);
+	$$ = ast_make_cond(builder, AST_COND_OR, $1, $4);
 }
 		 | unit { $$ = $1; }
 		 ;
 
-unit: unit PL_PIPE break command { $$ = ast_make_pipe($1, $4); }
+unit: unit PL_PIPE break command { $$ = ast_make_pipe(builder, $1, $4); }
 	| command { $$ = $1; }
 	;
 
-command: prefix body redirect_list {
-	$$ = ast_make_run(AST_RUN_APPLY,
-			$1,
-			ast_make_run(AST_RUN_APPLY,
-				$3,
-				ast_make_run(AST_RUN_EXECUTE, $2, NULL)
-		)
-	);
-}
-	   | prefix body {
-	$$ = ast_make_run(AST_RUN_APPLY,
-		$1,
-		ast_make_run(AST_RUN_EXECUTE, $2, NULL)
-	);
-}
-	   | prefix { $$ = ast_make_run(AST_RUN_SHELL_ENV, $1, NULL); }
-	   | body redirect_list {
-	$$ = ast_make_run(AST_RUN_APPLY,
-		$2,
-		ast_make_run(AST_RUN_EXECUTE, $1, NULL)
-	);
-}
-	   | body { $$ = ast_make_run(AST_RUN_EXECUTE, $1, NULL); }
+command: prefix body redirect_list { $$ = ast_make_command(builder); }
+	   | prefix body { $$ = ast_make_command(builder); }
+	   | prefix { $$ = ast_make_command(builder); }
+	   | body redirect_list { $$ = ast_make_command(builder); }
+	   | body { $$ = ast_make_command(builder); }
 	   ;
 
-prefix: prefix ASSIGNMENT { $$ = ast_make_join($1, $2); }
-	  | prefix redirect { $$ = ast_make_join($1, $2); }
-	  | ASSIGNMENT { $$ = $1; }
-	  | redirect { $$ = $1; }
+// Command parts are collected by the builder in order of appearance
+prefix: prefix ASSIGNMENT { ast_command_push(builder, $2); }
+	  | prefix redirect { ast_command_push(builder, $2); }
+	  | ASSIGNMENT { ast_command_push(builder, $1); }
+	  | redirect { ast_command_push(builder, $1); }
 	  ;
 
-body: body WORD { $$ = ast_make_join($1, $2); }
-	| WORD { $$ = $1; }
+body: body WORD { ast_command_push(builder, $2); }
+	| WORD { ast_command_push(builder, $1); }
 	;
 
-redirect_list: redirect_list redirect { $$ = ast_make_join($1, $2); }
-			 | redirect { $$ = $1; }
+redirect_list: redirect_list redirect { ast_command_push(builder, $2); }
+			 | redirect { ast_command_push(builder, $1); }
 			 ;
 
-redirect: FDNUM redirect_op WORD { $$ = ast_make_rdr($2, $1, $3); }
-		| redirect_op WORD { $$ = ast_make_rdr($1, ast_make_fdnum(-1), $2); }
+redirect: FDNUM redirect_op WORD { $$ = ast_make_rdr(builder, $2, $1, $3); }
+		| redirect_op WORD {
+	$$ = ast_make_rdr(builder, $1, ast_make_fdnum(builder, -1), $2);
+}
 		;
 
 redirect_op: RO_NORMAL { $$ = AST_RDR_O_NORMAL; }
@@ -147,14 +137,20 @@ redirect_op: RO_NORMAL { $$ = AST_RDR_O_NORMAL; }
 		   | RI_IO { $$ = AST_RDR_I_IO; }
 		   ;
 
-break: NEWLINES
+// Comment lines split newlines into several tokens
+break: newlines
 	 | // epsilon
 	 ;
 
+newlines: newlines NEWLINES
+		| NEWLINES
+		;
+
 separator: LS_SEQ { $$ = AST_SEQ_NORMAL; }
 		 | LS_ASYNC { $$ = AST_SEQ_ASYNC; }
 		 ;
 
 %%
 
-void yyerror(ast_node **root, const char *msg) {}
+void yyerror(void *scanner, ast_builder *builder, ast_node **root,
+	const char *msg) {}
@@ -10,28 +10,182 @@
 #include "parse.h"
 
 #include <stdlib.h>
+#include <string.h>
 
 #include "../util/error.h"
+#include "../util/hashmap.h"
 #include "ast.h"
 
-// Needed to interface with Flex & Yacc
-typedef void *YY_BUFFER_STATE;
-extern int yyparse(ast_node **root);
-extern YY_BUFFER_STATE yy_scan_string(const char *str);
-extern void yy_delete_buffer(YY_BUFFER_STATE buffer);
+// Maximum number of unused trees kept around
+#define CACHE_CAPACITY 64
+
+typedef struct cache_entry {
+	// Interned by the lookup table
+	const char *key;
+	arena mem;
+	ast_node *root;
+	// Number of evaluations currently using the tree
+	uint32_t users;
+
+	// Recency list, most recent first
+	struct cache_entry *prev;
+	struct cache_entry *next;
+} cache_entry;
 
-ast_node *parse_from_string(const char *str) {
-	YY_BUFFER_STATE buffer = yy_scan_string(str);
+// Needed to interface with Flex & Yacc (reentrant scanner, pure parser)
+typedef void *yyscan_t;
+typedef void *YY_BUFFER_STATE;
+extern int yyparse(yyscan_t scanner, ast_builder *builder, ast_node **root);
+extern int yylex_init_extra(ast_builder *extra, yyscan_t *scanner);
+extern int yylex_destroy(yyscan_t scanner);
+extern YY_BUFFER_STATE yy_scan_buffer(
+	char *base, size_t size, yyscan_t scanner);
+extern void yy_delete_buffer(YY_BUFFER_STATE buffer, yyscan_t scanner);
 
-	ast_node *root = NULL;
-	int result = yyparse(&root);
+static hashmap cache_table = { .slots = NULL, .capacity = 0, .count = 0 };
+static cache_entry *recent_head = NULL;
+static cache_entry *recent_tail = NULL;
 
-	yy_delete_buffer(buffer);
+static void move_to_front(cache_entry *entry);
+static void unlink_entry(cache_entry *entry);
+static void evict_unused(void);
 
-	if (result != 0) {
+ast_node *parse_from_string(const char *str, arena *mem) {
+	ast_node *root;
+	if (parse_tree(str, mem, &root) < 0) {
+		// Partial tree is left in the arena
 		print_error("syntax error\n");
 		return NULL;
 	}
 
 	return root;
 }
+
+int parse_tree(const char *str, arena *mem, ast_node **root) {
+	*root = NULL;
+
+	// Single copy, scanned in place; word nodes point into it
+	size_t length = strlen(str);
+	char *input = arena_alloc(mem, length + 2);
+	memcpy(input, str, length);
+	input[length] = '\0';
+	input[length + 1] = '\0';
+
+	// All parser state is local, so parses can nest or run concurrently
+	ast_builder builder = ast_builder_init(mem);
+	yyscan_t scanner;
+	if (yylex_init_extra(&builder, &scanner) != 0) {
+		print_error("failed to initialize lexer\n");
+		return -1;
+	}
+
+	YY_BUFFER_STATE buffer = yy_scan_buffer(input, length + 2, scanner);
+
+	int result = yyparse(scanner, &builder, root);
+
+	yy_delete_buffer(buffer, scanner);
+	yylex_destroy(scanner);
+	ast_end_views(&builder);
+	ast_builder_deinit(&builder);
+
+	return (result == 0) ? 0 : -1;
+}
+
+ast_node *parse_cached(const char *str) {
+	cache_entry *entry = hashmap_get(&cache_table, str);
+	if (entry != NULL) {
+		unlink_entry(entry);
+		move_to_front(entry);
+		entry->users++;
+		return entry->root;
+	}
+
+	arena mem = arena_init();
+	ast_node *root = parse_from_string(str, &mem);
+	if (root == NULL) {
+		arena_deinit(&mem);
+		return NULL;
+	}
+
+	entry = malloc(sizeof(cache_entry));
+	entry->mem = mem;
+	entry->root = root;
+	entry->users = 1;
+
+	hashmap_set(&cache_table, str, entry);
+	entry->key = hashmap_key(&cache_table, str);
+	move_to_front(entry);
+
+	evict_unused();
+	return root;
+}
+
+void parse_release(const ast_node *root) {
+	// Usually the tree that was acquired last
+	for (cache_entry *trav = recent_head; trav != NULL; trav = trav->next) {
+		if (trav->root == root) {
+			trav->users--;
+			break;
+		}
+	}
+
+	evict_unused();
+}
+
+/** Internal */
+
+/**
+ * @brief Insert an entry at the front of the recency list.
+ *
+ * @param[in] entry - Cache entry (not in the list).
+ */
+static void move_to_front(cache_entry *entry) {
+	entry->prev = NULL;
+	entry->next = recent_head;
+	if (recent_head != NULL) {
+		recent_head->prev = entry;
+	} else {
+		recent_tail = entry;
+	}
+
+	recent_head = entry;
+}
+
+/**
+ * @brief Remove an entry from the recency list.
+ *
+ * @param[in] entry - Cache entry.
+ */
+static void unlink_entry(cache_entry *entry) {
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		recent_head = entry->next;
+	}
+
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		recent_tail = entry->prev;
+	}
+}
+
+/**
+ * @brief Drop least recently used trees over capacity.
+ * @note Trees still being evaluated are skipped.
+ */
+static void evict_unused(void) {
+	cache_entry *trav = recent_tail;
+	while (cache_table.count > CACHE_CAPACITY && trav != NULL) {
+		cache_entry *prev = trav->prev;
+
+		if (trav->users == 0) {
+			unlink_entry(trav);
+			arena_deinit(&trav->mem);
+			hashmap_remove(&cache_table, trav->key);
+			free(trav);
+		}
+
+		trav = prev;
+	}
+}
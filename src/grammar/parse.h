@@ -8,12 +8,42 @@
  */
 #pragma once
 
+#include "../util/arena.h"
 #include "ast.h"
 
 /**
  * @brief Run the mesh parser on a string input.
  *
  * @param[in] str - Input string.
- * @return Generated AST.
+ * @param[in] mem - Arena that will own the tree.
+ * @return Generated AST; NULL on error.
+ * @note Tree, including its strings, is freed by resetting the arena.
  */
-ast_node *parse_from_string(const char *str);
+ast_node *parse_from_string(const char *str, arena *mem);
+
+/**
+ * @brief Run the mesh parser without reporting syntax errors.
+ *
+ * @param[in] str - Input string.
+ * @param[in] mem - Arena that will own the tree.
+ * @param[out] root - Generated AST; NULL for empty input.
+ * @return 0 on success; -1 on syntax error.
+ */
+int parse_tree(const char *str, arena *mem, ast_node **root);
+
+/**
+ * @brief Parse a string, reusing the tree of an earlier identical input.
+ *
+ * @param[in] str - Input string.
+ * @return Shared, read-only AST; NULL on error.
+ * @note Every successful call must be paired with parse_release.
+ * @note Cache is shared; only parse_from_string is safe to use from threads.
+ */
+ast_node *parse_cached(const char *str);
+
+/**
+ * @brief Stop using a tree returned by parse_cached.
+ *
+ * @param[in] root - Tree root.
+ */
+void parse_release(const ast_node *root);
@@ -7,37 +7,47 @@
  */
 #define _POSIX_C_SOURCE 200809L
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <c-utils/nanorl.h>
 #include <c-utils/vector.h>
 
 #include "core/eval.h"
+#include "core/events.h"
+#include "core/jobs.h"
 #include "core/scope.h"
 #include "core/vars.h"
 #include "ext/context.h"
 #include "grammar/ast.h"
 #include "grammar/expand.h"
+#include "grammar/image.h"
+#include "grammar/input.h"
 #include "grammar/parse.h"
 #include "util/error.h"
 
 #define PS1_ROOT "# "
 #define PS1_USER "$ "
 
-#define PID_STR_MAX_LEN 32
-
 #ifndef MESH_VERSION
 #define MESH_VERSION "0.3.0"
 #endif
 
-void run_from_stream(FILE *stream);
+static void run_from_stream(FILE *stream);
+static void wait_for_input(const char *prompt);
 static void set_vars(void);
-static void run_script(const char *filename);
-static int process_cmd(char *buffer);
+static int run_script(const char *filename);
+static int run_image(int fd, const char *filename);
+static int run_image_line(const image_line *line);
+static int run_from_fd(int fd);
+static int run_commands(input_reader *reader);
+static int process_cmd(const char *buffer);
 
 int main(int argc, char **argv) {
 	set_argv0((const char *const *)argv);
@@ -62,7 +72,9 @@ int main(int argc, char **argv) {
 						scope_append_pos(argv[i]);
 					}
 
-					return process_cmd(argv[2]);
+					// Generated scripts can hold several commands
+					input_reader reader = input_init_string(argv[2]);
+					return run_commands(&reader);
 				} else {
 					print_error("'-c': requires an argument\n");
 					return 1;
@@ -78,12 +90,21 @@ int main(int argc, char **argv) {
 			scope_append_pos(argv[i]);
 		}
 
-		run_script(argv[1]);
-		return 1;
+		return run_script(argv[1]);
 	}
 
-	signal(SIGINT, SIG_IGN);
-	signal(SIGQUIT, SIG_IGN);
+	if (!isatty(STDIN_FILENO)) {
+		// Command streams are read in blocks, not through the line editor;
+		// like scripts, they keep default signal handling
+		return run_from_fd(STDIN_FILENO);
+	}
+
+	// Event loop is only for the interactive shell
+	if (events_init() < 0) {
+		signal(SIGINT, SIG_IGN);
+		signal(SIGQUIT, SIG_IGN);
+	}
+	jobs_init();
 
 	while (1) {
 		run_from_stream(stdin);
@@ -97,11 +118,21 @@ int main(int argc, char **argv) {
  *
  * @param[in] stream - File stream.
  */
-void run_from_stream(FILE *stream) {
+static void run_from_stream(FILE *stream) {
 	int last_result = 0;
 
+	// Report finished background jobs
+	jobs_notify();
+
+	const char *prompt = vars_get("PS1");
+	if (stream == stdin && events_active() && isatty(STDIN_FILENO)) {
+		wait_for_input(prompt);
+	}
+
+	// Only errors from the line editor itself count below
+	errno = 0;
 	nrl_error err;
-	char *input = nanorl(vars_get("PS1"), &err);
+	char *input = nanorl(prompt, &err);
 	switch (err) {
 	case NRL_ERR_BAD_FD:
 		print_error("cannot read commands from this source\n");
@@ -127,12 +158,54 @@ void run_from_stream(FILE *stream) {
 	}
 
 	// Return code variable
-	char var_result[16];
-	snprintf(var_result, 16, "%d", last_result);
-	vars_set("?", var_result);
+	vars_set_int("?", last_result);
 	free(input);
 }
 
+/**
+ * @brief Show prompt and handle events until the user starts typing.
+ *
+ * @param[in] prompt - Prompt string.
+ */
+static void wait_for_input(const char *prompt) {
+	// nanorl redraws the prompt over the current line
+	if (prompt == NULL || strchr(prompt, '\n') != NULL) {
+		return;
+	}
+
+	// Interrupts left over from the last command are dropped, but child
+	// notifications are edge-triggered and must be handled now
+	int pending = events_wait(-1, 0);
+	if (pending > 0 && (pending & EVENT_CHILD)) {
+		jobs_notify();
+	}
+
+	fputs(prompt, stdout);
+	fflush(stdout);
+
+	while (1) {
+		int ready = events_wait(STDIN_FILENO, -1);
+		if (ready < 0 || (ready & EVENT_INPUT)) {
+			break;
+		}
+
+		if (ready & EVENT_INTERRUPT) {
+			putchar('\n');
+		} else if ((ready & EVENT_CHILD) && jobs_reap() > 0) {
+			putchar('\n');
+			jobs_notify();
+		} else {
+			continue;
+		}
+
+		fputs(prompt, stdout);
+		fflush(stdout);
+	}
+
+	putchar('\r');
+	fflush(stdout);
+}
+
 /**
  * @brief Load environment and set shell variables.
  */
@@ -148,10 +221,7 @@ static void set_vars(void) {
 	}
 
 	// PID
-	pid_t pid = getpid();
-	char pid_str[PID_STR_MAX_LEN];
-	snprintf(pid_str, PID_STR_MAX_LEN, "%d", pid);
-	vars_set("$", pid_str);
+	vars_set_int("$", getpid());
 
 	// PWD
 	char *pwd = getcwd(NULL, 0);
@@ -163,18 +233,113 @@ static void set_vars(void) {
  * @brief Run shell script file.
  *
  * @param[in] filename - Script filename.
+ * @return Status code.
  */
-static void run_script(const char *filename) {
-	FILE *script = fopen(filename, "r");
-	if (!script) {
+static int run_script(const char *filename) {
+	int fd = open(filename, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
 		print_error("failed to open file: %s\n", strerror(errno));
-		return;
+		return 1;
 	}
 
-	// Will exit
-	while (1) {
-		run_from_stream(script);
+	struct stat info;
+	if (fstat(fd, &info) < 0) {
+		print_error("failed to open file: %s\n", strerror(errno));
+		close(fd);
+		return 1;
 	}
+
+	// Pipes and devices are run as they are read
+	int result = S_ISREG(info.st_mode) ? run_image(fd, filename)
+									   : run_from_fd(fd);
+	close(fd);
+	return result;
+}
+
+/**
+ * @brief Run a regular script file through its compiled image.
+ *
+ * @param[in] fd - Script file descriptor.
+ * @param[in] filename - Script filename.
+ * @return Status code.
+ */
+static int run_image(int fd, const char *filename) {
+	// Compiled once, later runs reuse the cached image
+	script_image image;
+	if (image_load(fd, filename, &image) < 0) {
+		return 1;
+	}
+
+	int last_result = 0;
+	for (uint32_t i = 0; i < image.count; i++) {
+		// Blank and comment lines leave $? alone
+		if (image.lines[i].type == IMAGE_LINE_EMPTY) {
+			continue;
+		}
+
+		jobs_notify();
+
+		last_result = run_image_line(image.lines + i);
+		vars_set_int("?", last_result);
+	}
+
+	image_free(&image);
+	return last_result;
+}
+
+/**
+ * @brief Run one line of a script image.
+ *
+ * @param[in] line - Image line.
+ * @return Status code.
+ */
+static int run_image_line(const image_line *line) {
+	switch (line->type) {
+	case IMAGE_LINE_TREE: {
+		int result = eval_ast(line->root);
+		if (line->text[0] != ':') {
+			context_hist_add(strdup(line->text));
+		}
+
+		return result;
+	}
+	case IMAGE_LINE_TEXT:
+		return process_cmd(line->text);
+	default:
+		return 0;
+	}
+}
+
+/**
+ * @brief Run commands read from a non-interactive source.
+ *
+ * @param[in] fd - Input file descriptor.
+ * @return Status code.
+ */
+static int run_from_fd(int fd) {
+	input_reader reader = input_init(fd);
+	return run_commands(&reader);
+}
+
+/**
+ * @brief Run every command from a reader.
+ *
+ * @param[in,out] reader - Reader object; freed.
+ * @return Status code.
+ */
+static int run_commands(input_reader *reader) {
+	int last_result = 0;
+	char *command;
+	int status;
+	while ((status = input_next(reader, &command)) > 0) {
+		jobs_notify();
+
+		last_result = process_cmd(command);
+		vars_set_int("?", last_result);
+	}
+
+	input_deinit(reader);
+	return (status < 0) ? 1 : last_result;
 }
 
 /**
@@ -183,20 +348,21 @@ static void run_script(const char *filename) {
  * @param[in] buffer - Raw command.
  * @return Status code.
  */
-static int process_cmd(char *buffer) {
+static int process_cmd(const char *buffer) {
 	char *processed;
 	if (preprocess_buffer(buffer, &processed) < 0) {
 		return 1;
 	}
 
-	ast_node *root = parse_from_string(processed);
+	// Repeated history and context rows skip the parser
+	ast_node *root = parse_cached(processed);
 	if (root == NULL) {
 		free(processed);
 		return 1;
 	}
 
 	int result = eval_ast(root);
-	ast_recurse_free(root);
+	parse_release(root);
 
 	if (processed[0] != ':') {
 		context_hist_add(processed);
@@ -0,0 +1,104 @@
+/**
+ * @file util/arena.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Bump allocator for short-lived objects.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+#define MIN_CHUNK_SIZE 4096
+#define MAX_CHUNK_SIZE (1024 * 1024)
+
+struct arena_chunk {
+	arena_chunk *next;
+	size_t size;
+	size_t used;
+	// Padded so data starts aligned
+	unsigned char pad[ARENA_ALIGN - 3 * sizeof(size_t) % ARENA_ALIGN];
+	unsigned char data[];
+};
+
+static arena_chunk *new_chunk(arena_chunk *next, size_t min_size);
+
+arena arena_init(void) {
+	arena mem = { .head = NULL };
+	return mem;
+}
+
+void *arena_alloc(arena *mem, size_t size) {
+	size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+	arena_chunk *chunk = mem->head;
+	if (chunk == NULL || chunk->size - chunk->used < size) {
+		chunk = new_chunk(chunk, size);
+		mem->head = chunk;
+	}
+
+	void *ptr = chunk->data + chunk->used;
+	chunk->used += size;
+	return ptr;
+}
+
+char *arena_strdup(arena *mem, const char *str) {
+	size_t length = strlen(str) + 1;
+	char *copy = arena_alloc(mem, length);
+	memcpy(copy, str, length);
+	return copy;
+}
+
+void arena_reset(arena *mem) {
+	if (mem->head == NULL) {
+		return;
+	}
+
+	// Newest chunk is usually the largest, keep it
+	arena_chunk *trav = mem->head->next;
+	while (trav != NULL) {
+		arena_chunk *next = trav->next;
+		free(trav);
+		trav = next;
+	}
+
+	mem->head->next = NULL;
+	mem->head->used = 0;
+}
+
+void arena_deinit(arena *mem) {
+	arena_reset(mem);
+	free(mem->head);
+	mem->head = NULL;
+}
+
+/** Internal */
+
+/**
+ * @brief Allocate a new chunk, doubling the size of the previous one.
+ *
+ * @param[in] next - Previous chunk; may be NULL.
+ * @param[in] min_size - Required usable size.
+ * @return New chunk.
+ */
+static arena_chunk *new_chunk(arena_chunk *next, size_t min_size) {
+	size_t size = (next == NULL) ? MIN_CHUNK_SIZE : next->size * 2;
+	if (size > MAX_CHUNK_SIZE) {
+		size = MAX_CHUNK_SIZE;
+	}
+	if (size < min_size) {
+		size = min_size;
+	}
+
+	arena_chunk *chunk = malloc(sizeof(arena_chunk) + size);
+	chunk->next = next;
+	chunk->size = size;
+	chunk->used = 0;
+
+	return chunk;
+}
@@ -0,0 +1,57 @@
+/**
+ * @file util/arena.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Bump allocator for short-lived objects.
+ */
+#pragma once
+
+#include <stddef.h>
+
+typedef struct arena_chunk arena_chunk;
+
+typedef struct arena {
+	// Newest chunk; allocations are made from here
+	arena_chunk *head;
+} arena;
+
+/**
+ * @brief Initialize an empty arena (does not allocate).
+ *
+ * @return Arena object.
+ */
+arena arena_init(void);
+
+/**
+ * @brief Allocate memory from the arena.
+ *
+ * @param[in] mem - Arena object.
+ * @param[in] size - Size in bytes.
+ * @return Aligned memory; valid until the arena is reset.
+ */
+void *arena_alloc(arena *mem, size_t size);
+
+/**
+ * @brief Duplicate a string into the arena.
+ *
+ * @param[in] mem - Arena object.
+ * @param[in] str - String.
+ * @return Copy; valid until the arena is reset.
+ */
+char *arena_strdup(arena *mem, const char *str);
+
+/**
+ * @brief Free all allocations at once, keeping the newest chunk for reuse.
+ *
+ * @param[in] mem - Arena object.
+ */
+void arena_reset(arena *mem);
+
+/**
+ * @brief Free all arena memory.
+ *
+ * @param[in] mem - Arena object.
+ */
+void arena_deinit(arena *mem);
@@ -22,8 +22,10 @@
 
 #define CONF_ROOT ".config/mesh/"
 #define CONF_CTX (CONF_ROOT "ctx/")
+#define CONF_CACHE (CONF_ROOT "cache/")
 
 static char *path_conf_ctx = NULL;
+static char *path_conf_cache = NULL;
 
 static int mkdir_p(char *path);
 
@@ -68,6 +70,17 @@ const char *fs_conf_ctx(void) {
 	return path_conf_ctx;
 }
 
+const char *fs_conf_cache(void) {
+	if (path_conf_cache == NULL) {
+		path_conf_cache = malloc(sizeof(char) * PATH_MAX);
+		strcpy(path_conf_cache, vars_get("HOME"));
+
+		fs_path_cat(path_conf_cache, CONF_CACHE);
+	}
+
+	return path_conf_cache;
+}
+
 /**
  * @brief Recursive helper for 'fs_mkdir_p'.
  *
@@ -39,3 +39,10 @@ int fs_mkdir_p(const char *path);
  * @return File path to the directory.
  */
 const char *fs_conf_ctx(void);
+
+/**
+ * @brief Get absolute file location of the compiled script cache directory.
+ *
+ * @return File path to the directory.
+ */
+const char *fs_conf_cache(void);
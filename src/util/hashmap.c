@@ -0,0 +1,206 @@
+/**
+ * @file util/hashmap.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief String-keyed open addressing hash table.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "hashmap.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 16
+
+// FNV-1a parameters
+#define FNV_OFFSET 2166136261u
+#define FNV_PRIME 16777619u
+
+static hashmap_slot *find_slot(const hashmap *map, const char *key,
+	uint32_t hash);
+static void grow(hashmap *map);
+
+hashmap hashmap_init(void) {
+	hashmap map = {
+		.slots = NULL,
+		.capacity = 0,
+		.count = 0,
+	};
+
+	return map;
+}
+
+void hashmap_deinit(hashmap *map, void (*free_value)(void *)) {
+	hashmap_clear(map, free_value);
+	free(map->slots);
+
+	map->slots = NULL;
+	map->capacity = 0;
+}
+
+void hashmap_clear(hashmap *map, void (*free_value)(void *)) {
+	for (uint32_t i = 0; i < map->capacity; i++) {
+		hashmap_slot *slot = map->slots + i;
+		if (slot->key == NULL) {
+			continue;
+		}
+
+		if (free_value != NULL) {
+			free_value(slot->value);
+		}
+		free(slot->key);
+		slot->key = NULL;
+	}
+
+	map->count = 0;
+}
+
+void *hashmap_get(const hashmap *map, const char *key) {
+	if (map->count == 0) {
+		return NULL;
+	}
+
+	hashmap_slot *slot = find_slot(map, key, hashmap_hash(key));
+	return (slot->key != NULL) ? slot->value : NULL;
+}
+
+const char *hashmap_key(const hashmap *map, const char *key) {
+	if (map->count == 0) {
+		return NULL;
+	}
+
+	return find_slot(map, key, hashmap_hash(key))->key;
+}
+
+void *hashmap_set(hashmap *map, const char *key, void *value) {
+	// Keep load factor under 3/4
+	if ((map->count + 1) * 4 > map->capacity * 3) {
+		grow(map);
+	}
+
+	uint32_t hash = hashmap_hash(key);
+	hashmap_slot *slot = find_slot(map, key, hash);
+	if (slot->key != NULL) {
+		void *old = slot->value;
+		slot->value = value;
+		return old;
+	}
+
+	slot->key = strdup(key);
+	slot->value = value;
+	slot->hash = hash;
+	map->count++;
+
+	return NULL;
+}
+
+void *hashmap_remove(hashmap *map, const char *key) {
+	if (map->count == 0) {
+		return NULL;
+	}
+
+	hashmap_slot *slot = find_slot(map, key, hashmap_hash(key));
+	if (slot->key == NULL) {
+		return NULL;
+	}
+
+	void *value = slot->value;
+	free(slot->key);
+	slot->key = NULL;
+	map->count--;
+
+	// Backward shift deletion - no tombstones needed
+	uint32_t mask = map->capacity - 1;
+	uint32_t hole = slot - map->slots;
+	uint32_t i = (hole + 1) & mask;
+	while (map->slots[i].key != NULL) {
+		uint32_t home = map->slots[i].hash & mask;
+
+		// Move back if the hole is between home and current position
+		if (((i - home) & mask) >= ((i - hole) & mask)) {
+			map->slots[hole] = map->slots[i];
+			map->slots[i].key = NULL;
+			hole = i;
+		}
+
+		i = (i + 1) & mask;
+	}
+
+	return value;
+}
+
+const hashmap_slot *hashmap_next(const hashmap *map, uint32_t *iter) {
+	while (*iter < map->capacity) {
+		const hashmap_slot *slot = map->slots + (*iter)++;
+		if (slot->key != NULL) {
+			return slot;
+		}
+	}
+
+	return NULL;
+}
+
+uint32_t hashmap_hash(const char *str) {
+	uint32_t hash = FNV_OFFSET;
+	while (*str != '\0') {
+		hash ^= (unsigned char)*str++;
+		hash *= FNV_PRIME;
+	}
+
+	return hash;
+}
+
+/** Internal */
+
+/**
+ * @brief Find the slot holding a key or the empty slot where it belongs.
+ *
+ * @param[in] map - Hash table object (capacity must be non-zero).
+ * @param[in] key - Entry key.
+ * @param[in] hash - Key hash.
+ * @return Slot pointer.
+ */
+static hashmap_slot *find_slot(const hashmap *map, const char *key,
+	uint32_t hash) {
+	uint32_t mask = map->capacity - 1;
+	uint32_t i = hash & mask;
+
+	while (1) {
+		hashmap_slot *slot = map->slots + i;
+		if (slot->key == NULL) {
+			return slot;
+		}
+		if (slot->hash == hash && strcmp(slot->key, key) == 0) {
+			return slot;
+		}
+
+		i = (i + 1) & mask;
+	}
+}
+
+/**
+ * @brief Double the capacity and rehash all entries.
+ *
+ * @param[in] map - Hash table object.
+ */
+static void grow(hashmap *map) {
+	uint32_t old_capacity = map->capacity;
+	hashmap_slot *old_slots = map->slots;
+
+	map->capacity = (old_capacity == 0) ? INITIAL_CAPACITY : old_capacity * 2;
+	map->slots = calloc(map->capacity, sizeof(hashmap_slot));
+
+	for (uint32_t i = 0; i < old_capacity; i++) {
+		hashmap_slot *old = old_slots + i;
+		if (old->key == NULL) {
+			continue;
+		}
+
+		*find_slot(map, old->key, old->hash) = *old;
+	}
+
+	free(old_slots);
+}
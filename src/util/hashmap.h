@@ -0,0 +1,102 @@
+/**
+ * @file util/hashmap.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief String-keyed open addressing hash table.
+ */
+#pragma once
+
+#include <stdint.h>
+
+typedef struct {
+	char *key;
+	void *value;
+	uint32_t hash;
+} hashmap_slot;
+
+typedef struct {
+	hashmap_slot *slots;
+	uint32_t capacity;
+	uint32_t count;
+} hashmap;
+
+/**
+ * @brief Initialize an empty hash table.
+ *
+ * @return Hash table object.
+ */
+hashmap hashmap_init(void);
+
+/**
+ * @brief Free hash table memory.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] free_value - Called on every value; may be NULL.
+ */
+void hashmap_deinit(hashmap *map, void (*free_value)(void *));
+
+/**
+ * @brief Remove all entries from the hash table.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] free_value - Called on every value; may be NULL.
+ */
+void hashmap_clear(hashmap *map, void (*free_value)(void *));
+
+/**
+ * @brief Get value by key.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] key - Entry key.
+ * @return Stored value; NULL if not found.
+ */
+void *hashmap_get(const hashmap *map, const char *key);
+
+/**
+ * @brief Get the table's copy of a key.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] key - Entry key.
+ * @return Stored key; NULL if not found.
+ * @note Valid until the entry is removed.
+ */
+const char *hashmap_key(const hashmap *map, const char *key);
+
+/**
+ * @brief Insert or replace value.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] key - Entry key (copied).
+ * @param[in] value - Stored value.
+ * @return Replaced value; NULL if the key is new.
+ */
+void *hashmap_set(hashmap *map, const char *key, void *value);
+
+/**
+ * @brief Remove entry by key.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in] key - Entry key.
+ * @return Removed value; NULL if not found.
+ */
+void *hashmap_remove(hashmap *map, const char *key);
+
+/**
+ * @brief Iterate over occupied slots.
+ *
+ * @param[in] map - Hash table object.
+ * @param[in,out] iter - Iterator state; start from 0.
+ * @return Next slot; NULL when done.
+ * @note Table must not be modified during iteration.
+ */
+const hashmap_slot *hashmap_next(const hashmap *map, uint32_t *iter);
+
+/**
+ * @brief Hash a string.
+ *
+ * @param[in] str - String.
+ * @return Hash value.
+ */
+uint32_t hashmap_hash(const char *str);
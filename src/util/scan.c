@@ -0,0 +1,148 @@
+/**
+ * @file util/scan.c
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Vectorized search for special characters.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include "scan.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define HAVE_X86_SIMD
+#endif
+
+typedef size_t (*span_func)(const char *str, const char *chars);
+
+static span_func select_impl(void);
+static size_t span_scalar(const char *str, const char *chars);
+
+size_t scan_span(const char *str, const char *chars) {
+	static span_func impl = NULL;
+	if (impl == NULL) {
+		impl = select_impl();
+	}
+
+	return impl(str, chars);
+}
+
+/** Internal */
+
+#ifdef HAVE_X86_SIMD
+
+// Blocks are aligned, so reads never cross into an unmapped page
+#define SIMD_SCAN \
+	__attribute__((no_sanitize_address)) __attribute__((noinline))
+
+/**
+ * @brief SSE2 implementation of scan_span.
+ *
+ * @param[in] str - Null-terminated string.
+ * @param[in] chars - Characters to stop at.
+ * @return Run length.
+ */
+__attribute__((target("sse2"))) SIMD_SCAN static size_t span_sse2(
+	const char *str, const char *chars) {
+	__m128i needles[SCAN_MAX_CHARS + 1];
+	uint32_t count = 0;
+	needles[count++] = _mm_setzero_si128();
+	while (*chars != '\0' && count <= SCAN_MAX_CHARS) {
+		needles[count++] = _mm_set1_epi8(*chars++);
+	}
+
+	uintptr_t offset = (uintptr_t)str & 15;
+	const char *block = str - offset;
+	uint32_t ignore = (1u << offset) - 1;
+
+	while (1) {
+		__m128i data = _mm_load_si128((const __m128i *)block);
+
+		__m128i hits = _mm_cmpeq_epi8(data, needles[0]);
+		for (uint32_t i = 1; i < count; i++) {
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(data, needles[i]));
+		}
+
+		uint32_t mask = (uint32_t)_mm_movemask_epi8(hits) & ~ignore;
+		if (mask != 0) {
+			return block + __builtin_ctz(mask) - str;
+		}
+
+		block += 16;
+		ignore = 0;
+	}
+}
+
+/**
+ * @brief AVX2 implementation of scan_span.
+ *
+ * @param[in] str - Null-terminated string.
+ * @param[in] chars - Characters to stop at.
+ * @return Run length.
+ */
+__attribute__((target("avx2"))) SIMD_SCAN static size_t span_avx2(
+	const char *str, const char *chars) {
+	__m256i needles[SCAN_MAX_CHARS + 1];
+	uint32_t count = 0;
+	needles[count++] = _mm256_setzero_si256();
+	while (*chars != '\0' && count <= SCAN_MAX_CHARS) {
+		needles[count++] = _mm256_set1_epi8(*chars++);
+	}
+
+	uintptr_t offset = (uintptr_t)str & 31;
+	const char *block = str - offset;
+	uint32_t ignore = (1u << offset) - 1;
+
+	while (1) {
+		__m256i data = _mm256_load_si256((const __m256i *)block);
+
+		__m256i hits = _mm256_cmpeq_epi8(data, needles[0]);
+		for (uint32_t i = 1; i < count; i++) {
+			hits = _mm256_or_si256(hits, _mm256_cmpeq_epi8(data, needles[i]));
+		}
+
+		uint32_t mask = (uint32_t)_mm256_movemask_epi8(hits) & ~ignore;
+		if (mask != 0) {
+			return block + __builtin_ctz(mask) - str;
+		}
+
+		block += 32;
+		ignore = 0;
+	}
+}
+
+#endif
+
+/**
+ * @brief Pick the widest implementation the CPU supports.
+ *
+ * @return Implementation function.
+ */
+static span_func select_impl(void) {
+#ifdef HAVE_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return &span_avx2;
+	}
+	if (__builtin_cpu_supports("sse2")) {
+		return &span_sse2;
+	}
+#endif
+
+	return &span_scalar;
+}
+
+/**
+ * @brief Portable implementation of scan_span.
+ *
+ * @param[in] str - Null-terminated string.
+ * @param[in] chars - Characters to stop at.
+ * @return Run length.
+ */
+static size_t span_scalar(const char *str, const char *chars) {
+	return strcspn(str, chars);
+}
@@ -0,0 +1,23 @@
+/**
+ * @file util/scan.h
+ * @author Vladyslav Aviedov <vladaviedov at protonmail dot com>
+ * @version 0.3.0
+ * @date 2024
+ * @license GPLv3.0
+ * @brief Vectorized search for special characters.
+ */
+#pragma once
+
+#include <stddef.h>
+
+// Maximum number of characters to search for
+#define SCAN_MAX_CHARS 4
+
+/**
+ * @brief Get length of the initial run without any of the given characters.
+ *
+ * @param[in] str - Null-terminated string.
+ * @param[in] chars - Characters to stop at (at most SCAN_MAX_CHARS).
+ * @return Run length; same as strcspn.
+ */
+size_t scan_span(const char *str, const char *chars);